@@ -8,16 +8,31 @@
 #include <vector>
 #include <sys/stat.h>
 #include <sys/mman.h>
-#include <utime.h>
+#include <sys/xattr.h>
 #include <syslog.h>
 #include <fcntl.h>
 #include <atomic> //to ask if it can be used
 #include <dirent.h>
 #include <cstring>
+#include <bitset>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 
 using namespace std;
 
 #define DEFAULT_SLEEP_TIME 20 //in seconds
+#define PART_FILE_SUFFIX ".fsd-part" //suffix of temporary file used to copy big files
+#define CHECKPOINT_FILE_SUFFIX ".fsd-ckpt" //suffix of file which stores progress of big file copy
+#define SMALL_FILE_SIZE (256 * 1024) //files up to this size are copied with single read and write
+#define WRITEBACK_CHUNK_SIZE (8 * 1024 * 1024) //in durable mode writeback is started after every chunk of big file
 
 struct FileInfo {
     string path;
@@ -25,8 +40,11 @@ struct FileInfo {
     //path to file in mirror directory, like /home/user/archive/1/2/file.txt -> /home/user/backup/1/2/file.txt
     //or /home/user/backup/1/2/file.txt -> /home/user/archive/1/2/file.txt
     string mirrorPath;
-    time_t lastModified{};
+    timespec lastModified{}; //nanosecond precision (st_mtim)
     size_t size{};
+
+    //stat failed with error other than ENOENT, file exists but its size and modification time are unknown
+    bool unreadable{};
 };
 
 enum Operation {
@@ -56,376 +74,2896 @@ namespace settings {
     int sleep_time = 0; //in seconds, if 0 (additional arg not supplied) then sleep is set to DEFAULT_SLEEP_TIME
     bool recursive = false; //store status of recursive mode (if true then daemon will copy all files in subdirectories)
     int big_file_mb = 5; //store size of big file in MB (when file is bigger than this value, it will be copied using mmap)
+    int checkpoint_mb = 64; //how often (in MB) progress of big file copy is saved, so it can be resumed
+    bool durable = false; //if true - copied files are published in batches, after their content is flushed to disk
+    int durable_batch = 1000; //max number of files copied between durability barriers
+
+    string snapshot_dir; //directory where snapshots of destination directory are created, empty if disabled
+    int snapshot_keep = 24; //number of snapshots kept, older ones are removed
+    int snapshot_interval = 3600; //minimal time in seconds between snapshots, 0 - snapshot after every iteration with changes
+
+    bool chunk_store = false; //if true - destination is deduplicated chunk store instead of plain directory tree
 
     atomic<bool> received_signal(
             false); //used to store if signal was received, if true then daemon wake up and reset it to false
     atomic<bool> daemon_busy(false); //used to prevent double daemon wake up (by signal)
     atomic<bool> daemon_awaiting_termination(false);
+
+    string filter_file; //path to global include/exclude rules file, empty if not supplied
+    string directory_filter_name; //name of per directory rules file (like .gitignore), empty if disabled
+
+    //metadata copied together with modification time (--preserve=mode,owner,xattr)
+    bool preserve_mode = false;
+    bool preserve_owner = false;
+    bool preserve_xattr = false;
+
+    bool once = false; //if true - synchronize once and exit, daemon is not created (--once)
+
+    bool simulation = false; //if true - engine works on in-memory filesystem (--simulate), logs are not saved
 }
 
-namespace utils {
+//filesystem operations used by synchronization engine (scan, copy, delete, mkdir, metadata)
+//PosixFileSystem calls Linux system calls, MemoryFileSystem keeps whole tree in memory and is used by --simulate
+//to benchmark and fuzz synchronization of huge trees without touching disk
+//all functions follow POSIX conventions - on error they return -1 (or false) and set errno
+namespace vfs {
+
+    struct DirectoryEntry {
+        string name;
+        bool isDirectory;
+    };
+
+    struct FileStat {
+        bool isDirectory = false;
+        size_t size = 0;
+        timespec lastModified{};
+        dev_t device = 0;
+        mode_t mode = 0; //permission bits only
+        uid_t owner = 0;
+        gid_t group = 0;
+    };
+
+    class FileSystem {
+    public:
+        virtual ~FileSystem() = default;
+
+        //entries of directory without `.` and `..`
+        virtual bool list_directory(const string &path, vector<DirectoryEntry> &entries) = 0;
+        virtual bool stat(const string &path, FileStat &result) = 0;
+        virtual bool exists(const string &path) = 0;
+        virtual bool make_directory(const string &path) = 0;
+        virtual bool remove_file(const string &path) = 0;
+        virtual bool remove_directory(const string &path) = 0;
+        virtual bool rename(const string &from, const string &to) = 0;
+
+        //flags are the same as for open(2): O_RDONLY, O_WRONLY, O_CREAT, O_TRUNC
+        virtual int open(const string &path, int flags) = 0;
+        //directory descriptor is used to open many files of one directory without resolving whole path again
+        virtual int open_directory(const string &path) = 0;
+        virtual int open_at(int directoryFd, const string &name, int flags) = 0;
+        virtual bool close(int fd) = 0;
+        virtual bool fstat(int fd, FileStat &result) = 0;
+        virtual ssize_t read(int fd, void *buffer, size_t size) = 0;
+        virtual ssize_t write(int fd, const void *buffer, size_t size) = 0;
+        virtual ssize_t pwrite(int fd, const void *buffer, size_t size, size_t offset) = 0;
+        virtual bool truncate(int fd, size_t size) = 0;
+        //copy whole content of source file into empty destination file, data can be shared instead of copied
+        virtual bool copy_content(int sourceFd, int destinationFd) = 0;
+
+        //metadata is changed using open descriptor, so path is not resolved again
+        virtual bool set_modification_time(int fd, const timespec &time) = 0;
+        virtual bool set_mode(int fd, mode_t mode) = 0;
+        virtual bool set_owner(int fd, uid_t owner, gid_t group) = 0;
+        virtual bool copy_extended_attributes(int sourceFd, int destinationFd) = 0;
+
+        //read only view of whole file content, nullptr on error
+        virtual const char *map(int fd, size_t size) = 0;
+        virtual void unmap(const char *data, size_t size) = 0;
+
+        virtual bool sync_data(int fd) = 0;
+        virtual void start_writeback(int fd, size_t offset, size_t length) = 0;
+        virtual bool sync_filesystem(int fd) = 0;
+    };
+
+    class PosixFileSystem : public FileSystem {
+    public:
+        bool list_directory(const string &path, vector<DirectoryEntry> &entries) override {
+            DIR *dir = opendir(path.c_str());
+            if (dir == nullptr) return false;
+
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != nullptr) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+                //stat is called only when filesystem doesn't report entry type (or entry is symbolic link)
+                bool isDirectory = entry->d_type == DT_DIR;
+                if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+                    FileStat entryStat;
+                    isDirectory = stat(path + "/" + entry->d_name, entryStat) && entryStat.isDirectory;
+                }
+                entries.push_back({entry->d_name, isDirectory});
+            }
 
-    void display_usage(const string &path) {
-        string usage = "Usage: " + path +
-                       " sourcePath destinationPath [-d|--debug] [-R|--recursive] [-s=<sleep_time>|--sleep_time=<sleep_time>] [-B=<size_mb>|--big-file-size=<size_mb>]\n"
-                       "\n"
-                       "Description:\n"
-                       "    FileSyncDaemon is a program that synchronizes files between two directories. It can be run as a daemon process to continuously monitor the directories and automatically synchronize any changes.\n"
-                       "\n"
-                       "Arguments:\n"
-                       "    sourcePath        The path to the source directory.\n"
-                       "    destinationPath   The path to the destination directory.\n"
-                       "\n"
-                       "Options:\n"
-                       "    -d, --debug              Enable debug mode.\n"
-                       "    -R, --recursive          Synchronize directories recursively.\n"
-                       "    -s, --sleep_time         The time in seconds to sleep between iterations. Default value is 10.\n"
-                       "    -B:5, --big-file-size:5  Fize size when daemon will use mapping file. Default value is 5.\n"
-                       "\n"
-                       "Example usage:\n"
-                       "    " + path + " /home/user/source /mnt/backup -R -s=5";
-        cout << usage << endl;
-    }
+            closedir(dir);
+            return true;
+        }
 
-    string get_operation_name(Operation operation) {
-        switch (operation) {
-            case DAEMON_SLEEP:
-                return "DAEMON_SLEEP";
-            case DAEMON_INIT:
-                return "DAEMON_INIT";
-            case DAEMON_WAKE_UP_BY_SIGNAL:
-                return "DAEMON_WAKE_UP_BY_SIGNAL";
-            case DAEMON_WAKE_UP_DEFAULT_TIMER:
-                return "DAEMON_WAKE_UP_DEFAULT_TIMER";
-            case DAEMON_WAKE_UP_CUSTOM_TIMER:
-                return "DAEMON_WAKE_UP_CUSTOM_TIMER";
-            case SIGNAL_RECEIVED:
-                return "SIGNAL_RECEIVED";
-            case DAEMON_INIT_ERROR:
-                return "DAEMON_INIT_ERROR";
-            case DAEMON_WORK_INFO:
-                return "DAEMON_WORK_INFO";
-            case FILE_OPERATION_INFO:
-                return "FILE_OPERATION_INFO";
-            case FILE_OPERATION_ERROR:
-                return "FILE_OPERATION_ERROR";
+        static void convert_stat(const struct stat &source, FileStat &result) {
+            result.isDirectory = S_ISDIR(source.st_mode);
+            result.size = (size_t) source.st_size;
+            result.lastModified = source.st_mtim;
+            result.device = source.st_dev;
+            result.mode = source.st_mode & 07777;
+            result.owner = source.st_uid;
+            result.group = source.st_gid;
         }
 
-        return "UNKNOWN_OPERATION";
-    }
+        bool stat(const string &path, FileStat &result) override {
+            struct stat path_stat{};
+            if (::stat(path.c_str(), &path_stat) == -1) return false;
+            convert_stat(path_stat, result);
+            return true;
+        }
 
-    bool string_contain(const string &text, const string &contains) {
-        if (text.find(contains, 0) != string::npos) {
+        bool exists(const string &path) override {
+            return access(path.c_str(), F_OK) != -1;
+        }
+
+        bool make_directory(const string &path) override {
+            return mkdir(path.c_str(), 0777) == 0;
+        }
+
+        bool remove_file(const string &path) override {
+            return remove(path.c_str()) == 0;
+        }
+
+        bool remove_directory(const string &path) override {
+            return rmdir(path.c_str()) == 0;
+        }
+
+        bool rename(const string &from, const string &to) override {
+            return ::rename(from.c_str(), to.c_str()) == 0;
+        }
+
+        int open(const string &path, int flags) override {
+            return ::open(path.c_str(), flags, 0666);
+        }
+
+        int open_directory(const string &path) override {
+            return ::open(path.c_str(), O_RDONLY | O_DIRECTORY);
+        }
+
+        int open_at(int directoryFd, const string &name, int flags) override {
+            return openat(directoryFd, name.c_str(), flags, 0666);
+        }
+
+        bool close(int fd) override {
+            return ::close(fd) == 0;
+        }
+
+        bool fstat(int fd, FileStat &result) override {
+            struct stat fd_stat{};
+            if (::fstat(fd, &fd_stat) == -1) return false;
+            convert_stat(fd_stat, result);
             return true;
         }
-        return false;
-    }
 
-    string get_current_date_and_time() {
-        ostringstream oss;
-        time_t now = time(nullptr);
-        tm *local_time = localtime(&now);
-        oss << put_time(local_time, "%Y-%m-%d %H:%M:%S");
-        return oss.str();
-    }
+        ssize_t read(int fd, void *buffer, size_t size) override {
+            return ::read(fd, buffer, size);
+        }
 
-    bool is_file_or_directory_exists(const string &path) {
-        if (access(path.c_str(), F_OK) != -1) {
+        ssize_t write(int fd, const void *buffer, size_t size) override {
+            return ::write(fd, buffer, size);
+        }
+
+        ssize_t pwrite(int fd, const void *buffer, size_t size, size_t offset) override {
+            return ::pwrite(fd, buffer, size, (off_t) offset);
+        }
+
+        bool truncate(int fd, size_t size) override {
+            return ftruncate(fd, (off_t) size) == 0;
+        }
+
+        //reflink (shared extents) first, then copy_file_range and then read/write copy
+        bool copy_content(int sourceFd, int destinationFd) override {
+            if (ioctl(destinationFd, FICLONE, sourceFd) == 0) return true;
+
+            ssize_t copied;
+            size_t total = 0;
+            while ((copied = copy_file_range(sourceFd, nullptr, destinationFd, nullptr, 1024 * 1024 * 1024, 0)) > 0) {
+                total += copied;
+            }
+            if (copied == 0) return true;
+
+            //copy_file_range is not supported (for example old kernel or cross filesystem copy)
+            if (total > 0) return false;
+
+            char buffer[64 * 1024];
+            ssize_t readBytes;
+            while ((readBytes = ::read(sourceFd, buffer, sizeof(buffer))) > 0) {
+                for (ssize_t offset = 0; offset < readBytes;) {
+                    ssize_t written = ::write(destinationFd, buffer + offset, (size_t) (readBytes - offset));
+                    if (written <= 0) return false;
+                    offset += written;
+                }
+            }
+            return readBytes == 0;
+        }
+
+        bool set_modification_time(int fd, const timespec &time) override {
+            //access time is set to the same value as modification time
+            timespec times[2] = {time, time};
+            return futimens(fd, times) == 0;
+        }
+
+        bool set_mode(int fd, mode_t mode) override {
+            return fchmod(fd, mode) == 0;
+        }
+
+        bool set_owner(int fd, uid_t owner, gid_t group) override {
+            return fchown(fd, owner, group) == 0;
+        }
+
+        //names of extended attributes, filesystem without xattrs has no attributes
+        static bool list_extended_attributes(int fd, vector<string> &names) {
+            ssize_t namesSize = flistxattr(fd, nullptr, 0);
+            if (namesSize == -1) return errno == ENOTSUP;
+
+            string buffer((size_t) namesSize, '\0');
+            namesSize = flistxattr(fd, &buffer[0], buffer.size());
+            if (namesSize == -1) return false;
+
+            //names are separated by null characters
+            for (size_t offset = 0; offset < (size_t) namesSize; offset += strlen(&buffer[offset]) + 1) {
+                names.emplace_back(&buffer[offset]);
+            }
             return true;
         }
-        return false;
-    }
 
-    bool is_a_directory(const string &path) {
-        if (!is_file_or_directory_exists(path)) {
-            return false;
+        //attributes which are not in source file are removed (destination could be truncated older version)
+        bool copy_extended_attributes(int sourceFd, int destinationFd) override {
+            vector<string> names, destinationNames;
+            if (!list_extended_attributes(sourceFd, names) ||
+                !list_extended_attributes(destinationFd, destinationNames)) {
+                return false;
+            }
+
+            bool result = true;
+            for (const auto &name: destinationNames) {
+                if (find(names.begin(), names.end(), name) == names.end() &&
+                    fremovexattr(destinationFd, name.c_str()) == -1) {
+                    result = false;
+                }
+            }
+
+            string value;
+            for (const auto &entry: names) {
+                const char *name = entry.c_str();
+                ssize_t valueSize = fgetxattr(sourceFd, name, nullptr, 0);
+                if (valueSize == -1) {
+                    result = false;
+                    continue;
+                }
+
+                value.resize((size_t) valueSize);
+                valueSize = fgetxattr(sourceFd, name, &value[0], value.size());
+                if (valueSize == -1 || fsetxattr(destinationFd, name, value.data(), (size_t) valueSize, 0) == -1) {
+                    result = false;
+                }
+            }
+            return result;
         }
 
-        struct stat path_stat{};
-        stat(path.c_str(), &path_stat);
-        return S_ISDIR(path_stat.st_mode);
-    }
+        const char *map(int fd, size_t size) override {
+            if (size == 0) return "";
+            void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            return data == MAP_FAILED ? nullptr : (const char *) data;
+        }
 
-    time_t get_file_modification_time(const string &path) {
-        struct stat path_stat{};
-        stat(path.c_str(), &path_stat);
-        return path_stat.st_mtime;
-    }
+        void unmap(const char *data, size_t size) override {
+            if (size > 0) munmap((void *) data, size);
+        }
 
-    //save logs to syslog
-    void log(Operation operation, const string &message) {
-        //FIXME ask if we have to use our custom date and time function or we can use param for syslog
-        string formattedMessage =
-                get_current_date_and_time() + " | " + get_operation_name(operation) + " | " + message;
-        if (settings::debug) cout << formattedMessage << endl;
+        bool sync_data(int fd) override {
+            return fdatasync(fd) == 0;
+        }
 
-        openlog("file_sync_daemon", LOG_PID, LOG_USER);
-        syslog(LOG_INFO, "%s", formattedMessage.c_str());
-        closelog();
-    }
+        void start_writeback(int fd, size_t offset, size_t length) override {
+            sync_file_range(fd, (off_t) offset, (off_t) length, SYNC_FILE_RANGE_WRITE);
+        }
+
+        bool sync_filesystem(int fd) override {
+            return syncfs(fd) == 0;
+        }
+    };
+
+    //latency and fault model of MemoryFileSystem, rates are probabilities (0 - 1) of failure per operation
+    struct FaultModel {
+        size_t latencyMicroseconds = 0; //simulated time added to every operation
+        size_t statLatencyMicroseconds = 0; //additional simulated time added to every stat (slow metadata)
+        double listErrorRate = 0; //listing of directory fails with EIO
+        double statErrorRate = 0; //stat fails with EIO
+        double readErrorRate = 0; //read fails with EIO
+        double shortWriteRate = 0; //write stores only part of buffer
+        size_t capacity = SIZE_MAX; //total size of files in bytes, write above capacity fails with ENOSPC
+    };
+
+    class MemoryFileSystem : public FileSystem {
+    public:
+        struct Node {
+            bool isDirectory = false;
+            string data;
+            timespec lastModified{};
+            mode_t mode = 0644;
+            uid_t owner = 0;
+            gid_t group = 0;
+            unordered_map<string, string> attributes; //extended attributes
+            set<string> children; //names of entries, only used by directories
+        };
+
+        FaultModel faults;
+        timespec clock{1, 0}; //modification time of written files, advanced by simulation
+        size_t operations = 0; //number of operations since creation
+        size_t simulatedMicroseconds = 0; //sum of latencies of all operations
+
+        explicit MemoryFileSystem(uint64_t seed) : random(seed) {
+            nodes["/"] = make_shared<Node>();
+            nodes["/"]->isDirectory = true;
+        }
+
+        //remove duplicated and trailing slashes, so /a//b/ and /a/b are the same node
+        static string normalize(const string &path) {
+            string result;
+            for (char c: path) {
+                if (c == '/' && !result.empty() && result.back() == '/') continue;
+                result += c;
+            }
+            if (result.size() > 1 && result.back() == '/') result.pop_back();
+            return result;
+        }
+
+        static string get_parent(const string &path) {
+            size_t slash = path.rfind('/');
+            return slash == 0 ? "/" : path.substr(0, slash);
+        }
+
+        static string get_name(const string &path) {
+            return path.substr(path.rfind('/') + 1);
+        }
+
+        Node *find(const string &path) {
+            auto it = nodes.find(normalize(path));
+            return it == nodes.end() ? nullptr : it->second.get();
+        }
+
+        //create file with all parent directories, used by simulation to build source tree (without faults)
+        //simulation advances clock in sub-second steps, so changes are visible only with nanosecond precision
+        void advance_clock(long nanoseconds) {
+            clock.tv_nsec += nanoseconds;
+            clock.tv_sec += clock.tv_nsec / 1000000000;
+            clock.tv_nsec %= 1000000000;
+        }
+
+        void put_file(const string &path, const string &data, const timespec &lastModified) {
+            string normalized = normalize(path);
+            string parent = get_parent(normalized);
+            if (find(parent) == nullptr) {
+                put_directory(parent);
+            }
+
+            auto &node = nodes[normalized];
+            if (node == nullptr) {
+                node = make_shared<Node>();
+                nodes[parent]->children.insert(get_name(normalized));
+            }
+            usedBytes = usedBytes - node->data.size() + data.size();
+            node->data = data;
+            node->lastModified = lastModified;
+        }
+
+        void put_directory(const string &path) {
+            string normalized = normalize(path);
+            if (find(normalized) != nullptr) return;
 
-    bool change_file_modification_time(const string &path, time_t time) {
-        struct utimbuf new_times{};
-        new_times.actime = time;
-        new_times.modtime = time;
-        if (utime(path.c_str(), &new_times) == 0) {
+            string parent = get_parent(normalized);
+            put_directory(parent);
+            auto node = make_shared<Node>();
+            node->isDirectory = true;
+            nodes[normalized] = node;
+            nodes[parent]->children.insert(get_name(normalized));
+        }
+
+        void erase(const string &path) {
+            string normalized = normalize(path);
+            Node *node = find(normalized);
+            if (node == nullptr) return;
+
+            usedBytes -= node->data.size();
+            nodes[get_parent(normalized)]->children.erase(get_name(normalized));
+            nodes.erase(normalized);
+        }
+
+        bool list_directory(const string &path, vector<DirectoryEntry> &entries) override {
+            Node *node = lookup(path);
+            if (node == nullptr) return false;
+            if (!node->isDirectory) return fail(ENOTDIR);
+            if (inject(faults.listErrorRate)) return fail(EIO);
+
+            string prefix = normalize(path) + "/";
+            if (prefix == "//") prefix = "/";
+            for (const auto &name: node->children) {
+                entries.push_back({name, nodes[prefix + name]->isDirectory});
+            }
             return true;
         }
 
-        log(FILE_OPERATION_ERROR, "Can't change modification time for file: " + path + " due to error: " +
-                                  strerror(errno));
-        return false;
-    }
+        bool stat(const string &path, FileStat &result) override {
+            simulatedMicroseconds += faults.statLatencyMicroseconds;
+            Node *node = lookup(path);
+            if (node == nullptr) return false;
+            if (inject(faults.statErrorRate)) return fail(EIO);
 
-    bool read_write_file_copy(const string &source, const string &destination) {
-        //use linux read/write system calls
-        int sourceFd = open(source.c_str(), O_RDONLY);
-        int destinationFd = open(destination.c_str(), O_WRONLY | O_CREAT, 0666);
-        if (sourceFd == -1 || destinationFd == -1) {
-            return false;
+            fill_stat(*node, result);
+            return true;
         }
 
-        char buffer[1024];
-        ssize_t readBytes;
-        while ((readBytes = read(sourceFd, buffer, sizeof(buffer))) > 0) {
-            if (write(destinationFd, buffer, readBytes) != readBytes) {
-                utils::log(FILE_OPERATION_ERROR, "Can't write to file: " + destination + " due to error: " +
-                                                 strerror(errno));
-                return false;
+        bool exists(const string &path) override {
+            return lookup(path) != nullptr;
+        }
+
+        bool make_directory(const string &path) override {
+            tick();
+            string normalized = normalize(path);
+            if (find(normalized) != nullptr) return fail(EEXIST);
+
+            Node *parent = find(get_parent(normalized));
+            if (parent == nullptr) return fail(ENOENT);
+            if (!parent->isDirectory) return fail(ENOTDIR);
+
+            put_directory(normalized);
+            return true;
+        }
+
+        bool remove_file(const string &path) override {
+            Node *node = lookup(path);
+            if (node == nullptr) return false;
+            if (node->isDirectory) return fail(EISDIR);
+
+            erase(path);
+            return true;
+        }
+
+        bool remove_directory(const string &path) override {
+            Node *node = lookup(path);
+            if (node == nullptr) return false;
+            if (!node->isDirectory) return fail(ENOTDIR);
+            if (!node->children.empty()) return fail(ENOTEMPTY);
+
+            erase(path);
+            return true;
+        }
+
+        bool rename(const string &from, const string &to) override {
+            string source = normalize(from), target = normalize(to);
+            if (lookup(source) == nullptr) return false;
+
+            Node *targetParent = find(get_parent(target));
+            if (targetParent == nullptr) return fail(ENOENT);
+
+            Node *existing = find(target);
+            if (existing != nullptr && existing->isDirectory) return fail(EISDIR);
+            if (nodes[source]->isDirectory) return fail(EINVAL); //engine never renames directories
+            if (existing != nullptr) erase(target);
+
+            shared_ptr<Node> node = nodes[source];
+            nodes[get_parent(source)]->children.erase(get_name(source));
+            nodes.erase(source);
+            nodes[target] = node;
+            nodes[get_parent(target)]->children.insert(get_name(target));
+            return true;
+        }
+
+        int open(const string &path, int flags) override {
+            string normalized = normalize(path);
+            Node *node = lookup(normalized);
+            if (node == nullptr) {
+                if (!(flags & O_CREAT)) return -1;
+
+                Node *parent = find(get_parent(normalized));
+                if (parent == nullptr) return fail_descriptor(ENOENT);
+                if (!parent->isDirectory) return fail_descriptor(ENOTDIR);
+
+                put_file(normalized, "", clock);
+                node = find(normalized);
+            } else if (node->isDirectory && (flags & O_ACCMODE) != O_RDONLY) {
+                return fail_descriptor(EISDIR);
+            }
+
+            if (flags & O_TRUNC) {
+                usedBytes -= node->data.size();
+                node->data.clear();
+                node->lastModified = clock;
             }
 
+            int fd = nextFd++;
+            openFiles[fd] = {nodes[normalized], 0, normalized};
+            return fd;
         }
-        close(sourceFd);
-        close(destinationFd);
-        return true;
-    }
 
-    bool mmap_file_copy(const FileInfo &source, const string &destination) {
-        int sourceFd = open(source.path.c_str(), O_RDONLY);
-        int destinationFd = open(destination.c_str(), O_WRONLY | O_CREAT, 0666);
-        if (sourceFd == -1 || destinationFd == -1) {
-            return false;
+        int open_directory(const string &path) override {
+            Node *node = find(path);
+            if (node != nullptr && !node->isDirectory) return fail_descriptor(ENOTDIR);
+            return open(path, O_RDONLY);
         }
 
-        //map source file to memory
-        char *sourceMap = (char *) mmap(nullptr, source.size, PROT_READ, MAP_PRIVATE, sourceFd, 0);
-        if (sourceMap == MAP_FAILED) {
-            return false;
+        int open_at(int directoryFd, const string &name, int flags) override {
+            OpenFile *directory = get_open_file(directoryFd);
+            if (directory == nullptr) return -1;
+            if (!directory->node->isDirectory) return fail_descriptor(ENOTDIR);
+            return open(directory->path + "/" + name, flags);
         }
 
-        //write source file to destination path
-        if (write(destinationFd, sourceMap, source.size) != source.size) {
-            return false;
+        bool close(int fd) override {
+            tick();
+            return openFiles.erase(fd) == 1 || fail(EBADF);
         }
 
-        //deallocating map memory
-        munmap(sourceMap, source.size);
+        bool fstat(int fd, FileStat &result) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return false;
 
-        close(sourceFd);
-        close(destinationFd);
-        return true;
-    }
+            fill_stat(*file->node, result);
+            return true;
+        }
 
-    bool file_delete(const string &path) {
-        if (remove(path.c_str()) == 0) {
-            log(FILE_OPERATION_INFO, "File " + path + " removed");
+        ssize_t read(int fd, void *buffer, size_t size) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return -1;
+            if (inject(faults.readErrorRate)) return fail_descriptor(EIO);
+
+            const string &data = file->node->data;
+            size_t count = file->offset >= data.size() ? 0 : min(size, data.size() - file->offset);
+            memcpy(buffer, data.data() + file->offset, count);
+            file->offset += count;
+            return (ssize_t) count;
+        }
+
+        ssize_t write(int fd, const void *buffer, size_t size) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return -1;
+
+            ssize_t written = pwrite(fd, buffer, size, file->offset);
+            if (written > 0) file->offset += written;
+            return written;
+        }
+
+        ssize_t pwrite(int fd, const void *buffer, size_t size, size_t offset) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return -1;
+
+            if (size > 1 && inject(faults.shortWriteRate)) size /= 2;
+
+            string &data = file->node->data;
+            size_t newSize = max(data.size(), offset + size);
+            if (usedBytes - data.size() + newSize > faults.capacity) return fail_descriptor(ENOSPC);
+
+            usedBytes = usedBytes - data.size() + newSize;
+            if (newSize > data.size()) data.resize(newSize);
+            memcpy(&data[offset], buffer, size);
+            file->node->lastModified = clock;
+            return (ssize_t) size;
+        }
+
+        bool truncate(int fd, size_t size) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return false;
+
+            string &data = file->node->data;
+            if (usedBytes - data.size() + size > faults.capacity) return fail(ENOSPC);
+            usedBytes = usedBytes - data.size() + size;
+            data.resize(size);
             return true;
         }
 
-        log(FILE_OPERATION_ERROR, "File " + path + " remove failed due to " + strerror(errno));
-        return false;
-    }
+        bool copy_content(int sourceFd, int destinationFd) override {
+            OpenFile *source = get_open_file(sourceFd);
+            if (source == nullptr || get_open_file(destinationFd) == nullptr) return false;
 
-    bool directory_delete(const string &path) {
-        if (rmdir(path.c_str()) == 0) {
-            log(FILE_OPERATION_ERROR, "Directory " + path + " removed");
+            string data = source->node->data;
+            return pwrite(destinationFd, data.data(), data.size(), 0) == (ssize_t) data.size();
+        }
+
+        bool set_modification_time(int fd, const timespec &time) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return false;
+
+            file->node->lastModified = time;
             return true;
         }
 
-        log(FILE_OPERATION_INFO, "Directory " + path + " remove failed due to " + strerror(errno));
-        return false;
-    }
+        bool set_mode(int fd, mode_t mode) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return false;
+
+            file->node->mode = mode;
+            return true;
+        }
+
+        bool set_owner(int fd, uid_t owner, gid_t group) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return false;
+
+            file->node->owner = owner;
+            file->node->group = group;
+            return true;
+        }
+
+        bool copy_extended_attributes(int sourceFd, int destinationFd) override {
+            OpenFile *source = get_open_file(sourceFd);
+            OpenFile *destination = get_open_file(destinationFd);
+            if (source == nullptr || destination == nullptr) return false;
+
+            destination->node->attributes = source->node->attributes;
+            return true;
+        }
+
+        //content is returned directly, it can't be modified until view is released
+        const char *map(int fd, size_t size) override {
+            OpenFile *file = get_open_file(fd);
+            if (file == nullptr) return nullptr;
+            if (file->node->data.size() < size) {
+                errno = EINVAL;
+                return nullptr;
+            }
+            return file->node->data.data();
+        }
+
+        void unmap(const char *, size_t) override {}
+
+        bool sync_data(int fd) override {
+            return get_open_file(fd) != nullptr;
+        }
+
+        void start_writeback(int, size_t, size_t) override {}
+
+        bool sync_filesystem(int fd) override {
+            return get_open_file(fd) != nullptr;
+        }
+
+    private:
+        struct OpenFile {
+            shared_ptr<Node> node; //node is kept alive when file is removed or replaced while it is open
+            size_t offset;
+            string path; //used to open files relative to directory descriptor
+        };
+
+        unordered_map<string, shared_ptr<Node>> nodes; //key is normalized absolute path
+        unordered_map<int, OpenFile> openFiles;
+        int nextFd = 3;
+        size_t usedBytes = 0;
+        mt19937_64 random;
+
+        void tick() {
+            operations++;
+            simulatedMicroseconds += faults.latencyMicroseconds;
+        }
+
+        static bool fail(int error) {
+            errno = error;
+            return false;
+        }
+
+        static int fail_descriptor(int error) {
+            errno = error;
+            return -1;
+        }
+
+        bool inject(double rate) {
+            return rate > 0 && uniform_real_distribution<double>(0, 1)(random) < rate;
+        }
+
+        static void fill_stat(const Node &node, FileStat &result) {
+            result.isDirectory = node.isDirectory;
+            result.size = node.data.size();
+            result.lastModified = node.lastModified;
+            result.device = 1;
+            result.mode = node.mode;
+            result.owner = node.owner;
+            result.group = node.group;
+        }
+
+        //every path based operation starts with lookup, so it is counted (and delayed) here
+        Node *lookup(const string &path) {
+            tick();
+            Node *node = find(path);
+            if (node == nullptr) errno = ENOENT;
+            return node;
+        }
+
+        OpenFile *get_open_file(int fd) {
+            tick();
+            auto it = openFiles.find(fd);
+            if (it == openFiles.end()) {
+                errno = EBADF;
+                return nullptr;
+            }
+            return &it->second;
+        }
+    };
+
+    PosixFileSystem posix_filesystem;
+    FileSystem *current = &posix_filesystem; //filesystem used by synchronization engine
+
+    //read whole (small) file, like rules file or checkpoint
+    bool read_file(const string &path, string &content) {
+        int fd = current->open(path, O_RDONLY);
+        if (fd == -1) return false;
+
+        char buffer[4096];
+        ssize_t readBytes;
+        while ((readBytes = current->read(fd, buffer, sizeof(buffer))) > 0) {
+            content.append(buffer, readBytes);
+        }
+        current->close(fd);
+        return readBytes == 0;
+    }
+}
+
+//gitignore-style include/exclude rules
+//rules are compiled once into a matcher, so checking an entry doesn't need to loop over all patterns
+//  - exact names (`node_modules`) and paths (`/build/cache`) are stored in hash maps
+//  - `*.tmp` and `build*` like patterns are stored as literal suffixes/prefixes in hash maps
+//  - every other pattern is compiled into small glob automaton (NFA)
+//last matching rule wins, rule prefixed with `!` re-includes entry excluded by earlier rule
+namespace filter {
+
+    enum Verdict {
+        NO_MATCH,
+        INCLUDE,
+        EXCLUDE,
+    };
+
+    enum TokenType {
+        LITERAL, //single character
+        ANY_CHAR, //`?`, any character except `/`
+        STAR, //`*`, any sequence without `/`
+        GLOBSTAR, //`**`, any sequence, with `/` too
+        GLOBSTAR_SLASH_ENTRY, //`**/`, empty or any sequence ending with `/` (first state)
+        GLOBSTAR_SLASH_INNER, //`**/` (second state, entered after first consumed character)
+        CHAR_CLASS, //`[abc]`, `[a-z]`, `[!a-z]`
+    };
+
+    struct Token {
+        TokenType type;
+        char literal{};
+        bitset<256> charClass;
+    };
+
+    struct Rule {
+        bool negated = false; //rule starts with `!`, so it includes entry instead of excluding it
+        bool directoryOnly = false; //rule ends with `/`, so it matches only directories
+        bool matchPath = false; //rule contains `/`, so it is matched against relative path, not entry name
+        vector<Token> automaton; //compiled pattern, only used by rules which are not stored in hash maps
+    };
+
+    struct Matcher {
+        vector<Rule> rules;
+
+        //literal lookups, values are indexes of rules in `rules` vector
+        unordered_map<string, vector<size_t>> names;
+        unordered_map<string, vector<size_t>> paths;
+        unordered_map<string, vector<size_t>> suffixes;
+        unordered_map<string, vector<size_t>> prefixes;
+        vector<size_t> suffixLengths; //distinct lengths of suffixes, so lookup is done once per length
+        vector<size_t> prefixLengths;
+
+        vector<size_t> globs; //rules which need automaton
+
+        bool empty() const {
+            return rules.empty();
+        }
+    };
+
+    struct DirectoryScope {
+        string relativePath; //path of directory with rules file relative to synchronized root, ends with `/`
+        const Matcher *matcher;
+    };
+
+    Matcher global_rules;
+    unordered_map<string, Matcher> directory_rules; //per directory rules, key is relative directory path
+    vector<DirectoryScope> scope_stack; //per directory rules applied to currently scanned directory
+
+    bool has_wildcards(const string &pattern) {
+        return pattern.find_first_of("*?[\\") != string::npos;
+    }
+
+    vector<Token> compile_glob(const string &pattern) {
+        vector<Token> tokens;
+        for (size_t i = 0; i < pattern.size(); i++) {
+            char c = pattern[i];
+            Token token{LITERAL, c, {}};
+
+            if (c == '\\' && i + 1 < pattern.size()) {
+                token.literal = pattern[++i];
+            } else if (c == '?') {
+                token.type = ANY_CHAR;
+            } else if (c == '*') {
+                if (i + 1 < pattern.size() && pattern[i + 1] == '*') {
+                    i++;
+                    if (i + 1 < pattern.size() && pattern[i + 1] == '/') {
+                        i++;
+                        tokens.push_back({GLOBSTAR_SLASH_ENTRY, 0, {}});
+                        token.type = GLOBSTAR_SLASH_INNER;
+                    } else {
+                        token.type = GLOBSTAR;
+                    }
+                } else {
+                    token.type = STAR;
+                }
+            } else if (c == '[' && pattern.find(']', i + 2) != string::npos) {
+                token.type = CHAR_CLASS;
+                size_t j = i + 1;
+                bool negate = pattern[j] == '!' || pattern[j] == '^';
+                if (negate) j++;
+
+                //`]` right after `[` is treated as literal
+                do {
+                    unsigned char from = pattern[j];
+                    unsigned char to = from;
+                    if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+                        to = pattern[j + 2];
+                        j += 2;
+                    }
+                    for (unsigned int k = from; k <= to; k++) token.charClass.set(k);
+                    j++;
+                } while (j < pattern.size() && pattern[j] != ']');
+
+                if (negate) token.charClass.flip();
+                token.charClass.reset('/');
+                i = j;
+            }
+
+            tokens.push_back(token);
+        }
+        return tokens;
+    }
+
+    //add state to active states set, following all empty transitions
+    void add_state(const vector<Token> &tokens, vector<char> &states, size_t state) {
+        if (states[state]) return;
+        states[state] = 1;
+        if (state == tokens.size()) return;
+
+        TokenType type = tokens[state].type;
+        if (type == STAR || type == GLOBSTAR) {
+            add_state(tokens, states, state + 1);
+        } else if (type == GLOBSTAR_SLASH_ENTRY) {
+            add_state(tokens, states, state + 2);
+        }
+    }
+
+    //simulate automaton over text, every state is visited at most once per character
+    bool glob_match(const vector<Token> &tokens, const string &text) {
+        vector<char> current(tokens.size() + 1, 0);
+        vector<char> next(tokens.size() + 1, 0);
+        add_state(tokens, current, 0);
+
+        for (char ch: text) {
+            fill(next.begin(), next.end(), 0);
+            bool anyActive = false;
+
+            for (size_t state = 0; state < tokens.size(); state++) {
+                if (!current[state]) continue;
+                const Token &token = tokens[state];
+
+                switch (token.type) {
+                    case LITERAL:
+                        if (ch == token.literal) add_state(tokens, next, state + 1);
+                        break;
+                    case ANY_CHAR:
+                        if (ch != '/') add_state(tokens, next, state + 1);
+                        break;
+                    case STAR:
+                        if (ch != '/') add_state(tokens, next, state);
+                        break;
+                    case GLOBSTAR:
+                        add_state(tokens, next, state);
+                        break;
+                    case GLOBSTAR_SLASH_ENTRY:
+                        add_state(tokens, next, state + 1);
+                        if (ch == '/') add_state(tokens, next, state + 2);
+                        break;
+                    case GLOBSTAR_SLASH_INNER:
+                        add_state(tokens, next, state);
+                        if (ch == '/') add_state(tokens, next, state + 1);
+                        break;
+                    case CHAR_CLASS:
+                        if (token.charClass.test((unsigned char) ch)) add_state(tokens, next, state + 1);
+                        break;
+                }
+            }
+
+            swap(current, next);
+            for (char active: current) anyActive |= active != 0;
+            if (!anyActive) return false;
+        }
+
+        return current[tokens.size()] != 0;
+    }
+
+    void add_index(unordered_map<string, vector<size_t>> &map, const string &key, size_t index) {
+        map[key].push_back(index);
+    }
+
+    void add_length(vector<size_t> &lengths, size_t length) {
+        if (find(lengths.begin(), lengths.end(), length) == lengths.end()) {
+            lengths.push_back(length);
+        }
+    }
+
+    //parse single line of rules file and store compiled rule in matcher
+    void add_rule(Matcher &matcher, string line) {
+        //trailing spaces are ignored unless escaped with backslash
+        while (!line.empty() && (line.back() == ' ' || line.back() == '\r') &&
+               !(line.size() > 1 && line[line.size() - 2] == '\\')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') return;
+
+        Rule rule;
+        if (line[0] == '!') {
+            rule.negated = true;
+            line = line.substr(1);
+        } else if (line[0] == '\\' && line.size() > 1 && (line[1] == '!' || line[1] == '#')) {
+            line = line.substr(1);
+        }
+
+        if (!line.empty() && line.back() == '/') {
+            rule.directoryOnly = true;
+            line.pop_back();
+        }
+
+        //pattern with `/` at the beginning or in the middle is relative to rules file location
+        if (line.find('/') != string::npos) {
+            rule.matchPath = true;
+            if (line[0] == '/') line = line.substr(1);
+        }
+        if (line.empty()) return;
+
+        size_t index = matcher.rules.size();
+        string body = line.size() > 1 ? line.substr(1) : "";
+        string head = line.substr(0, line.size() - 1);
+
+        if (!has_wildcards(line)) {
+            add_index(rule.matchPath ? matcher.paths : matcher.names, line, index);
+        } else if (!rule.matchPath && line[0] == '*' && !body.empty() && !has_wildcards(body)) {
+            add_index(matcher.suffixes, body, index);
+            add_length(matcher.suffixLengths, body.size());
+        } else if (!rule.matchPath && line.back() == '*' && !head.empty() && !has_wildcards(head)) {
+            add_index(matcher.prefixes, head, index);
+            add_length(matcher.prefixLengths, head.size());
+        } else {
+            rule.automaton = compile_glob(line);
+            matcher.globs.push_back(index);
+        }
+
+        matcher.rules.push_back(rule);
+    }
+
+    bool load_rules_file(const string &path, Matcher &matcher) {
+        string content;
+        if (!vfs::read_file(path, content)) {
+            return false;
+        }
+
+        istringstream file(content);
+        string line;
+        while (getline(file, line)) {
+            add_rule(matcher, line);
+        }
+        return true;
+    }
+
+    //return index of last rule which matches entry, or -1 if none of them matches
+    long last_matching_rule(const Matcher &matcher, const string &relativePath, const string &name, bool isDirectory) {
+        long best = -1;
+
+        auto check_bucket = [&](const unordered_map<string, vector<size_t>> &map, const string &key) {
+            auto it = map.find(key);
+            if (it == map.end()) return;
+            for (size_t index: it->second) {
+                if ((long) index > best && (isDirectory || !matcher.rules[index].directoryOnly)) {
+                    best = (long) index;
+                }
+            }
+        };
+
+        check_bucket(matcher.names, name);
+        check_bucket(matcher.paths, relativePath);
+        for (size_t length: matcher.suffixLengths) {
+            if (length <= name.size()) check_bucket(matcher.suffixes, name.substr(name.size() - length));
+        }
+        for (size_t length: matcher.prefixLengths) {
+            if (length <= name.size()) check_bucket(matcher.prefixes, name.substr(0, length));
+        }
+
+        //globs are sorted by index, so check from the last one and stop on first match
+        for (auto it = matcher.globs.rbegin(); it != matcher.globs.rend() && (long) *it > best; ++it) {
+            const Rule &rule = matcher.rules[*it];
+            if (rule.directoryOnly && !isDirectory) continue;
+            if (glob_match(rule.automaton, rule.matchPath ? relativePath : name)) {
+                best = (long) *it;
+            }
+        }
+
+        return best;
+    }
+
+    Verdict evaluate(const Matcher &matcher, const string &relativePath, const string &name, bool isDirectory) {
+        long index = last_matching_rule(matcher, relativePath, name, isDirectory);
+        if (index == -1) return NO_MATCH;
+        return matcher.rules[index].negated ? INCLUDE : EXCLUDE;
+    }
+
+    bool is_enabled() {
+        return !global_rules.empty() || !settings::directory_filter_name.empty();
+    }
+
+    //check entry against global rules and then against rules of every parent directory (deeper one wins)
+    //relativePath is path relative to synchronized root directory (without leading `/`)
+    bool is_excluded(const string &relativePath, const string &name, bool isDirectory) {
+        Verdict verdict = evaluate(global_rules, relativePath, name, isDirectory);
+
+        for (const auto &scope: scope_stack) {
+            if (scope.matcher->empty()) continue;
+            Verdict scoped = evaluate(*scope.matcher, relativePath.substr(scope.relativePath.size()), name,
+                                      isDirectory);
+            if (scoped != NO_MATCH) verdict = scoped;
+        }
+
+        return verdict == EXCLUDE;
+    }
+
+    //push rules of directory, when load is false only rules already loaded (from source directory) are used
+    //so destination directory is filtered with the same rules as source directory
+    void enter_directory(const string &directory, const string &relativePath, bool load) {
+        if (settings::directory_filter_name.empty()) return;
+
+        auto it = directory_rules.find(relativePath);
+        if (it == directory_rules.end()) {
+            if (!load) return;
+
+            Matcher matcher;
+            load_rules_file(directory + "/" + settings::directory_filter_name, matcher);
+            it = directory_rules.emplace(relativePath, std::move(matcher)).first;
+        }
+
+        scope_stack.push_back({relativePath, &it->second});
+    }
+
+    void leave_directory(const string &relativePath) {
+        if (!scope_stack.empty() && scope_stack.back().relativePath == relativePath) {
+            scope_stack.pop_back();
+        }
+    }
+
+    //per directory rules may change between iterations, so they are loaded again during every source scan
+    void reset_directory_rules() {
+        directory_rules.clear();
+        scope_stack.clear();
+    }
+}
+
+namespace utils {
+
+    void display_usage(const string &path) {
+        string usage = "Usage: " + path +
+                       " sourcePath destinationPath [-d|--debug] [-R|--recursive] [--once] [-s=<sleep_time>|--sleep_time=<sleep_time>] [-B=<size_mb>|--big-file-size=<size_mb>]"
+                       " [-F=<path>|--filter-file=<path>] [--per-directory-filter[=<name>]] [-C=<size_mb>|--checkpoint-size=<size_mb>]"
+                       " [--durable[=<batch_files>]]"
+                       " [--snapshot-dir=<path>] [--snapshot-keep=<count>] [--snapshot-interval=<seconds>]"
+                       " [--chunk-store] [--preserve=mode,owner,xattr]\n"
+                       "       " + path + " --export storePath targetPath\n"
+                       "       " + path + " --simulate [--sim-files=<count>] [--sim-cycles=<count>] [--sim-churn=<fraction>]"
+                       " [--sim-seed=<seed>] [--sim-file-size=<bytes>] [--sim-latency-us=<us>] [--sim-stat-latency-us=<us>]"
+                       " [--sim-list-error-rate=<rate>] [--sim-stat-error-rate=<rate>] [--sim-read-error-rate=<rate>] [--sim-short-write-rate=<rate>]"
+                       " [--sim-capacity-mb=<size_mb>] [options]\n"
+                       "\n"
+                       "Description:\n"
+                       "    FileSyncDaemon is a program that synchronizes files between two directories. It can be run as a daemon process to continuously monitor the directories and automatically synchronize any changes.\n"
+                       "\n"
+                       "Arguments:\n"
+                       "    sourcePath        The path to the source directory.\n"
+                       "    destinationPath   The path to the destination directory.\n"
+                       "\n"
+                       "Options:\n"
+                       "    -d, --debug              Enable debug mode.\n"
+                       "    -R, --recursive          Synchronize directories recursively.\n"
+                       "    --once                   Synchronize once and exit, daemon is not created.\n"
+                       "    -s, --sleep_time         The time in seconds to sleep between iterations. Default value is 10.\n"
+                       "    -B=5, --big-file-size=5  Fize size when daemon will use mapping file. Default value is 5.\n"
+                       "    -F, --filter-file        Gitignore-style include/exclude rules file, excluded entries are not\n"
+                       "                             scanned, copied or deleted.\n"
+                       "    --per-directory-filter   Read additional rules from rules file in every source directory.\n"
+                       "                             Default rules file name is .syncignore.\n"
+                       "    -C=64, --checkpoint-size=64  How often (in MB) progress of big file copy is saved, so copy\n"
+                       "                             can be resumed after crash or restart. Default value is 64.\n"
+                       "    --durable[=1000]         Flush copied files to disk in batches (syncfs), files are renamed\n"
+                       "                             to destination paths only after their content is on disk.\n"
+                       "    --snapshot-dir           Create snapshot of destination directory after every successful\n"
+                       "                             iteration, unchanged files are hardlinked from previous snapshot.\n"
+                       "    --snapshot-keep=24       Number of kept snapshots, older ones are removed.\n"
+                       "    --snapshot-interval=3600 Minimal time in seconds between snapshots.\n"
+                       "    --chunk-store            Store files in destination as deduplicated chunks and recipes.\n"
+                       "    --preserve=mode,owner,xattr  Copy permissions, owner and extended attributes together with\n"
+                       "                             modification time (owner can be changed only by root).\n"
+                       "    --export                 Rebuild plain directory tree from chunk store.\n"
+                       "    --simulate               Benchmark synchronization on generated in-memory tree with injected\n"
+                       "                             latency and faults, destination is verified after every cycle.\n"
+                       "\n"
+                       "Example usage:\n"
+                       "    " + path + " /home/user/source /mnt/backup -R -s=5";
+        cout << usage << endl;
+    }
+
+    string get_operation_name(Operation operation) {
+        switch (operation) {
+            case DAEMON_SLEEP:
+                return "DAEMON_SLEEP";
+            case DAEMON_INIT:
+                return "DAEMON_INIT";
+            case DAEMON_WAKE_UP_BY_SIGNAL:
+                return "DAEMON_WAKE_UP_BY_SIGNAL";
+            case DAEMON_WAKE_UP_DEFAULT_TIMER:
+                return "DAEMON_WAKE_UP_DEFAULT_TIMER";
+            case DAEMON_WAKE_UP_CUSTOM_TIMER:
+                return "DAEMON_WAKE_UP_CUSTOM_TIMER";
+            case SIGNAL_RECEIVED:
+                return "SIGNAL_RECEIVED";
+            case DAEMON_INIT_ERROR:
+                return "DAEMON_INIT_ERROR";
+            case DAEMON_WORK_INFO:
+                return "DAEMON_WORK_INFO";
+            case FILE_OPERATION_INFO:
+                return "FILE_OPERATION_INFO";
+            case FILE_OPERATION_ERROR:
+                return "FILE_OPERATION_ERROR";
+        }
+
+        return "UNKNOWN_OPERATION";
+    }
+
+    bool string_contain(const string &text, const string &contains) {
+        if (text.find(contains, 0) != string::npos) {
+            return true;
+        }
+        return false;
+    }
+
+    bool string_starts_with(const string &text, const string &prefix) {
+        return text.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    string get_current_date_and_time() {
+        ostringstream oss;
+        time_t now = time(nullptr);
+        tm *local_time = localtime(&now);
+        oss << put_time(local_time, "%Y-%m-%d %H:%M:%S");
+        return oss.str();
+    }
+
+    bool is_file_or_directory_exists(const string &path) {
+        return vfs::current->exists(path);
+    }
+
+    bool is_a_directory(const string &path) {
+        vfs::FileStat path_stat;
+        return vfs::current->stat(path, path_stat) && path_stat.isDirectory;
+    }
+
+    //save logs to syslog
+    void log(Operation operation, const string &message) {
+        //FIXME ask if we have to use our custom date and time function or we can use param for syslog
+        string formattedMessage =
+                get_current_date_and_time() + " | " + get_operation_name(operation) + " | " + message;
+        if (settings::debug) cout << formattedMessage << endl;
+        if (settings::simulation) return;
+
+        openlog("file_sync_daemon", LOG_PID, LOG_USER);
+        syslog(LOG_INFO, "%s", formattedMessage.c_str());
+        closelog();
+    }
+
+    bool is_same_time(const timespec &first, const timespec &second) {
+        return first.tv_sec == second.tv_sec && first.tv_nsec == second.tv_nsec;
+    }
+
+    //seconds with nanosecond fraction, like 1700000000.123456789
+    string format_time(const timespec &time) {
+        char fraction[16];
+        snprintf(fraction, sizeof(fraction), ".%09ld", (long) time.tv_nsec);
+        return to_string(time.tv_sec) + fraction;
+    }
+
+    //path is used only in log message, time is set using open descriptor
+    bool change_file_modification_time(int fd, const string &path, const timespec &time) {
+        if (vfs::current->set_modification_time(fd, time)) {
+            return true;
+        }
+
+        log(FILE_OPERATION_ERROR, "Can't change modification time for file: " + path + " due to error: " +
+                                  strerror(errno));
+        return false;
+    }
+
+    //copy metadata of source file to destination file after its content is written
+    //mode, owner and extended attributes are copied only if enabled by --preserve, failure is logged but file is
+    //still synchronized (for example owner can't be changed without root privileges)
+    //modification time is set last, every write to destination file would change it
+    bool copy_metadata(int sourceFd, const vfs::FileStat &sourceStat, int destinationFd, const string &destination) {
+        //chown clears setuid and setgid bits, so chown is called before chmod
+        if (settings::preserve_owner && !vfs::current->set_owner(destinationFd, sourceStat.owner, sourceStat.group)) {
+            log(FILE_OPERATION_ERROR, "Can't change owner of file: " + destination + " due to error: " +
+                                      strerror(errno));
+        }
+        if (settings::preserve_mode && !vfs::current->set_mode(destinationFd, sourceStat.mode)) {
+            log(FILE_OPERATION_ERROR, "Can't change mode of file: " + destination + " due to error: " +
+                                      strerror(errno));
+        }
+        if (settings::preserve_xattr && !vfs::current->copy_extended_attributes(sourceFd, destinationFd)) {
+            log(FILE_OPERATION_ERROR, "Can't copy extended attributes of file: " + destination + " due to error: " +
+                                      strerror(errno));
+        }
+
+        return change_file_modification_time(destinationFd, destination, sourceStat.lastModified);
+    }
+
+    size_t get_file_size(const string &path) {
+        vfs::FileStat file_stat;
+        if (!vfs::current->stat(path, file_stat)) {
+            log(FILE_OPERATION_ERROR, "Can't get file size for " + path + " due to error: " + strerror(errno));
+            return 0;
+        }
+
+        return file_stat.size;
+    }
+
+    //in durable mode kernel is asked to start writing copied data immediately (without waiting for it)
+    //so barrier at the end of batch has less work to do
+    void start_writeback(int fd, size_t offset, size_t length) {
+        if (!settings::durable) return;
+        vfs::current->start_writeback(fd, offset, length);
+    }
+
+    //part file copied in current batch, it is published after durability barrier
+    struct PendingFile {
+        string partPath;
+        string destination;
+        string checkpointPath; //empty if file was copied without checkpoints
+        dev_t device; //filesystem of part file, syncfs is called once per filesystem
+
+        //value of failed_commits when file was started, if any commit failed since then, file is not published
+        //used by files which depend on files published before them (recipe depends on its chunks)
+        size_t failedCommits = SIZE_MAX;
+    };
+
+    vector<PendingFile> pending_files;
+    size_t failed_commits = 0; //number of part files which were not published
+
+    //metadata (modification time and optionally mode, owner and xattrs) is copied from source descriptor
+    bool read_write_file_copy(const string &source, const string &destination) {
+        //use linux read/write system calls
+        int sourceFd = vfs::current->open(source, O_RDONLY);
+        if (sourceFd == -1) {
+            return false;
+        }
+
+        //modification time is taken before reading, if file is modified during copy it will be copied again
+        vfs::FileStat sourceStat;
+        if (!vfs::current->fstat(sourceFd, sourceStat)) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+
+        //truncate destination, otherwise stale bytes are left at the end when source file shrinks
+        int destinationFd = vfs::current->open(destination, O_WRONLY | O_CREAT | O_TRUNC);
+        if (destinationFd == -1) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+
+        char buffer[1024];
+        ssize_t readBytes;
+        size_t offset = 0;
+        while ((readBytes = vfs::current->read(sourceFd, buffer, sizeof(buffer))) > 0) {
+            //write can store only part of buffer (short write), so repeat until whole buffer is written
+            for (ssize_t bufferOffset = 0; bufferOffset < readBytes;) {
+                ssize_t written = vfs::current->write(destinationFd, buffer + bufferOffset, readBytes - bufferOffset);
+                if (written <= 0) {
+                    utils::log(FILE_OPERATION_ERROR, "Can't write to file: " + destination + " due to error: " +
+                                                     strerror(errno));
+                    vfs::current->close(sourceFd);
+                    vfs::current->close(destinationFd);
+                    return false;
+                }
+                bufferOffset += written;
+            }
+            offset += readBytes;
+        }
+        start_writeback(destinationFd, 0, offset);
+
+        bool result = readBytes == 0 && copy_metadata(sourceFd, sourceStat, destinationFd, destination);
+        vfs::current->close(sourceFd);
+        vfs::current->close(destinationFd);
+        return result;
+    }
+
+    //big files are copied into temporary part file in destination directory, like
+    //  /home/user/backup/1/2/.file.iso.fsd-part
+    //progress is saved every few MB into checkpoint file, like
+    //  /home/user/backup/1/2/.file.iso.fsd-ckpt
+    //after crash or SIGTERM copy is resumed from last checkpoint (only if source file wasn't modified)
+    //part file is renamed to destination path after copy is finished, so nobody can see partially copied file
+    string get_part_file_path(const string &destination) {
+        size_t slash = destination.rfind('/') + 1;
+        return destination.substr(0, slash) + "." + destination.substr(slash) + PART_FILE_SUFFIX;
+    }
+
+    string get_checkpoint_file_path(const string &destination) {
+        size_t slash = destination.rfind('/') + 1;
+        return destination.substr(0, slash) + "." + destination.substr(slash) + CHECKPOINT_FILE_SUFFIX;
+    }
+
+    bool string_ends_with(const string &text, const string &suffix) {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    //part and checkpoint files are created by daemon, they are never synchronized
+    bool is_internal_file(const string &name) {
+        return name[0] == '.' && (string_ends_with(name, PART_FILE_SUFFIX) ||
+                                  string_ends_with(name, CHECKPOINT_FILE_SUFFIX));
+    }
+
+    //name of file which is copied using internal (part or checkpoint) file
+    string get_internal_file_target_name(const string &name) {
+        size_t suffixSize = string_ends_with(name, PART_FILE_SUFFIX) ? strlen(PART_FILE_SUFFIX)
+                                                                     : strlen(CHECKPOINT_FILE_SUFFIX);
+        return name.substr(1, name.size() - suffixSize - 1);
+    }
+
+    //checkpoint format: <source size> <source modification time (seconds nanoseconds)> <copied bytes>
+    //returns offset from which copy can be resumed, 0 if checkpoint is missing or source file was modified
+    size_t read_checkpoint(const string &checkpointPath, size_t sourceSize, const timespec &sourceModified) {
+        string content;
+        if (!vfs::read_file(checkpointPath, content)) {
+            return 0;
+        }
+
+        istringstream file(content);
+        size_t size = 0, offset = 0;
+        timespec modified{};
+        if (!(file >> size >> modified.tv_sec >> modified.tv_nsec >> offset)) {
+            return 0;
+        }
+
+        if (size != sourceSize || !is_same_time(modified, sourceModified) || offset > sourceSize) {
+            return 0;
+        }
+        return offset;
+    }
+
+    //checkpoint is written into temporary file and renamed, so it is never partially written
+    bool write_checkpoint(const string &checkpointPath, size_t sourceSize, const timespec &sourceModified,
+                          size_t offset) {
+        string temporaryPath = checkpointPath + ".tmp";
+        int fd = vfs::current->open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC);
+        if (fd == -1) {
+            return false;
+        }
+
+        string content = to_string(sourceSize) + " " + to_string(sourceModified.tv_sec) + " " +
+                         to_string(sourceModified.tv_nsec) + " " + to_string(offset) + "\n";
+        bool result = vfs::current->write(fd, content.c_str(), content.size()) == (ssize_t) content.size();
+        vfs::current->close(fd);
+
+        return result && vfs::current->rename(temporaryPath, checkpointPath);
+    }
+
+    //rename part file to destination path, metadata is already set (when copy was finished)
+    //checkpoint is removed before rename, part file without checkpoint is never resumed
+    bool commit_file(const PendingFile &file) {
+        if (!file.checkpointPath.empty()) {
+            vfs::current->remove_file(file.checkpointPath);
+        }
+
+        if (!vfs::current->rename(file.partPath, file.destination)) {
+            log(FILE_OPERATION_ERROR, "Can't rename file " + file.partPath + " to " + file.destination +
+                                      " due to error: " + strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    //flush data of all filesystems used by pending files, one syncfs per filesystem
+    //published - if true, files are already renamed, so filesystem is opened using destination path
+    bool sync_pending_filesystems(bool published) {
+        vector<dev_t> synced;
+        for (const auto &file: pending_files) {
+            if (find(synced.begin(), synced.end(), file.device) != synced.end()) continue;
+
+            const string &path = published ? file.destination : file.partPath;
+            int fd = vfs::current->open(path, O_RDONLY);
+            if (fd == -1 && published) continue; //file wasn't committed, try another one
+
+            if (fd == -1 || !vfs::current->sync_filesystem(fd)) {
+                log(FILE_OPERATION_ERROR, "Can't sync filesystem of file " + path + " due to error: " +
+                                          strerror(errno));
+                if (fd != -1) vfs::current->close(fd);
+                return false;
+            }
+            vfs::current->close(fd);
+            synced.push_back(file.device);
+        }
+        return true;
+    }
+
+    //durability barrier for batch of copied files (modification time of part file is set when copy is finished):
+    //  1. syncfs - content and metadata of all part files is on disk
+    //  2. part files are renamed to destination paths
+    //  3. syncfs - renames are on disk
+    //after power loss destination file either has old content or new content with correct modification time,
+    //file with correct modification time and garbage content (treated as synchronized forever) is not possible
+    //returns false if any of pending files wasn't published
+    bool commit_pending_files() {
+        if (pending_files.empty()) return true;
+
+        if (!sync_pending_filesystems(false)) {
+            log(FILE_OPERATION_ERROR, "Durability barrier failed, " + to_string(pending_files.size()) +
+                                      " files will be copied again in next iteration");
+            failed_commits += pending_files.size();
+            pending_files.clear();
+            return false;
+        }
+
+        size_t committed = 0;
+        for (const auto &file: pending_files) {
+            if (file.failedCommits != SIZE_MAX && file.failedCommits != failed_commits) {
+                log(FILE_OPERATION_ERROR, "File " + file.destination + " depends on file which wasn't published, "
+                                          "it will be copied again in next iteration");
+                vfs::current->remove_file(file.partPath);
+                failed_commits++;
+                continue;
+            }
+
+            if (commit_file(file)) {
+                committed++;
+            } else {
+                failed_commits++;
+            }
+        }
+
+        bool result = sync_pending_filesystems(true) && committed == pending_files.size();
+        log(FILE_OPERATION_INFO, "Durability barrier finished, committed " + to_string(committed) + " files");
+        pending_files.clear();
+        return result;
+    }
+
+    //publish copied part file, in durable mode it is delayed until end of batch
+    bool publish_file(const PendingFile &file) {
+        if (!settings::durable) {
+            if (commit_file(file)) return true;
+            failed_commits++;
+            return false;
+        }
+
+        pending_files.push_back(file);
+        if (pending_files.size() >= (size_t) settings::durable_batch) {
+            commit_pending_files();
+        }
+        return true;
+    }
+
+    bool mmap_file_copy(const FileInfo &source, const string &destination) {
+        string partPath = get_part_file_path(destination);
+        string checkpointPath = get_checkpoint_file_path(destination);
+
+        int sourceFd = vfs::current->open(source.path, O_RDONLY);
+        if (sourceFd == -1) {
+            return false;
+        }
+
+        //use current size and modification time, source could be modified after scan
+        vfs::FileStat sourceStat;
+        if (!vfs::current->fstat(sourceFd, sourceStat)) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+        size_t sourceSize = sourceStat.size;
+        const timespec &sourceModified = sourceStat.lastModified;
+
+        //resume only if part file contains all bytes confirmed by checkpoint
+        size_t offset = read_checkpoint(checkpointPath, sourceSize, sourceModified);
+        if (offset > 0 && get_file_size(partPath) < offset) {
+            offset = 0;
+        }
+
+        int partFd = vfs::current->open(partPath, O_WRONLY | O_CREAT | (offset == 0 ? O_TRUNC : 0));
+        if (partFd == -1) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+
+        if (offset > 0) {
+            log(FILE_OPERATION_INFO, "Resuming copy of file " + source.path + " from " + to_string(offset) + " bytes");
+        }
+
+        //map source file to memory
+        const char *sourceMap = vfs::current->map(sourceFd, sourceSize);
+        if (sourceMap == nullptr) {
+            vfs::current->close(sourceFd);
+            vfs::current->close(partFd);
+            return false;
+        }
+
+        //write source file to part file, chunk by chunk, saving checkpoint after each chunk
+        size_t checkpointBytes = (size_t) settings::checkpoint_mb * 1024 * 1024;
+        bool result = true;
+        while (offset < sourceSize) {
+            if (settings::daemon_awaiting_termination) {
+                log(FILE_OPERATION_INFO, "Copy of file " + source.path + " interrupted at " + to_string(offset) +
+                                         " bytes, it will be resumed after restart");
+                result = false;
+                break;
+            }
+
+            size_t chunkEnd = min(sourceSize, offset + checkpointBytes);
+            while (offset < chunkEnd) {
+                size_t length = min(chunkEnd - offset, (size_t) WRITEBACK_CHUNK_SIZE);
+                ssize_t written = vfs::current->pwrite(partFd, sourceMap + offset, length, offset);
+                if (written <= 0) {
+                    break;
+                }
+                start_writeback(partFd, offset, written);
+                offset += written;
+            }
+            if (offset < chunkEnd) {
+                log(FILE_OPERATION_ERROR, "Can't write to file: " + partPath + " due to error: " + strerror(errno));
+                result = false;
+                break;
+            }
+
+            //checkpoint can be saved only when data is on disk, otherwise resumed file could contain garbage
+            if (offset < sourceSize && (!vfs::current->sync_data(partFd) ||
+                                        !write_checkpoint(checkpointPath, sourceSize, sourceModified, offset))) {
+                log(FILE_OPERATION_ERROR, "Can't save checkpoint for file: " + partPath + " due to error: " +
+                                          strerror(errno));
+            }
+        }
+
+        //deallocating map memory
+        vfs::current->unmap(sourceMap, sourceSize);
+
+        //part file could be longer when previous copy was made from bigger version of file
+        vfs::FileStat partStat;
+        if (result && (!vfs::current->truncate(partFd, sourceSize) || !vfs::current->fstat(partFd, partStat) ||
+                       !copy_metadata(sourceFd, sourceStat, partFd, partPath))) {
+            result = false;
+        }
+        vfs::current->close(sourceFd);
+        vfs::current->close(partFd);
+
+        if (!result) {
+            return false;
+        }
+
+        return publish_file({partPath, destination, checkpointPath, partStat.device});
+    }
+
+    vector<char> small_file_buffer; //reused by all small file copies, it only grows up to SMALL_FILE_SIZE + 1
+
+    //small file is read with single read (buffer is sized from size found by scan) and written with single write
+    //files are opened relative to descriptors of their directories, which are opened once for all files of directory
+    //modification time from scan is used, so source file is not stat'ed again (unless other metadata is preserved)
+    bool small_file_copy(int sourceDirectoryFd, int destinationDirectoryFd, dev_t device, const FileInfo &source,
+                         const string &destination) {
+        string sourceName = source.path.substr(source.path.rfind('/') + 1);
+        string targetPath = settings::durable ? get_part_file_path(destination) : destination;
+        string targetName = targetPath.substr(targetPath.rfind('/') + 1);
+
+        int sourceFd = vfs::current->open_at(sourceDirectoryFd, sourceName, O_RDONLY);
+        if (sourceFd == -1) {
+            return false;
+        }
+
+        vfs::FileStat sourceStat;
+        sourceStat.lastModified = source.lastModified;
+        if ((settings::preserve_mode || settings::preserve_owner || settings::preserve_xattr) &&
+            !vfs::current->fstat(sourceFd, sourceStat)) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+
+        //one more byte is requested, so file which grew after scan is detected
+        if (small_file_buffer.size() < source.size + 1) {
+            small_file_buffer.resize(source.size + 1);
+        }
+        ssize_t readBytes = vfs::current->read(sourceFd, small_file_buffer.data(), source.size + 1);
+        if (readBytes != (ssize_t) source.size) {
+            //file was modified after scan (or read was interrupted), so it is copied like other files
+            vfs::current->close(sourceFd);
+            if (readBytes == -1) return false;
+
+            bool result = read_write_file_copy(source.path, targetPath);
+            vfs::FileStat targetStat;
+            return result && (!settings::durable || (vfs::current->stat(targetPath, targetStat) &&
+                                                     publish_file({targetPath, destination, "", targetStat.device})));
+        }
+
+        int destinationFd = vfs::current->open_at(destinationDirectoryFd, targetName, O_WRONLY | O_CREAT | O_TRUNC);
+        if (destinationFd == -1) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+
+        //write is repeated only after short write
+        size_t written = 0;
+        while (written < source.size) {
+            ssize_t result = vfs::current->write(destinationFd, small_file_buffer.data() + written,
+                                                 source.size - written);
+            if (result <= 0) break;
+            written += result;
+        }
+        if (written < source.size) {
+            log(FILE_OPERATION_ERROR, "Can't write to file: " + targetPath + " due to error: " + strerror(errno));
+        }
+        start_writeback(destinationFd, 0, written);
+
+        bool result = written == source.size && copy_metadata(sourceFd, sourceStat, destinationFd, targetPath);
+        vfs::current->close(sourceFd);
+        vfs::current->close(destinationFd);
+
+        return result && (!settings::durable || publish_file({targetPath, destination, "", device}));
+    }
+
+    bool file_delete(const string &path) {
+        if (vfs::current->remove_file(path)) {
+            log(FILE_OPERATION_INFO, "File " + path + " removed");
+            return true;
+        }
+
+        log(FILE_OPERATION_ERROR, "File " + path + " remove failed due to " + strerror(errno));
+        return false;
+    }
+
+    bool directory_delete(const string &path) {
+        if (vfs::current->remove_directory(path)) {
+            log(FILE_OPERATION_ERROR, "Directory " + path + " removed");
+            return true;
+        }
+
+        log(FILE_OPERATION_INFO, "Directory " + path + " remove failed due to " + strerror(errno));
+        return false;
+    }
+
+    bool directory_create(const string &path) {
+        if (vfs::current->make_directory(path)) {
+            log(FILE_OPERATION_INFO, "Directory " + path + " created");
+            return true;
+        }
+
+        log(FILE_OPERATION_ERROR, "Directory " + path + " creation failed due to " + strerror(errno));
+        return false;
+    }
+
+    //check if dirent entry is a directory, stat is called only when filesystem doesn't report entry type
+    bool is_directory_entry(const struct dirent *entry, const string &path) {
+        if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) {
+            return entry->d_type == DT_DIR;
+        }
+        return is_a_directory(path);
+    }
+
+    //relativePath is path of destination directory relative to synchronized root, used by filter rules
+    //returns true if destination directory is empty after removing its empty subdirectories
+    bool remove_empty_directories(const string &destination, const string &relativePath = "") {
+        //recursively remove empty directories inside destination directory
+        //loop over all directories inside destination directory
+
+        vector<vfs::DirectoryEntry> entries;
+        if (!vfs::current->list_directory(destination, entries)) {
+            log(FILE_OPERATION_ERROR, "Can't open directory " + destination + " due to error: " + strerror(errno));
+            return false;
+        }
+
+        filter::enter_directory(destination, relativePath, false);
+
+        size_t remainingEntries = entries.size();
+        //iterate over all files inside directory, if entry is directory call this function again (recursion)
+        for (const auto &entry: entries) {
+            if (!entry.isDirectory) continue;
+
+            //excluded directories are not synchronized, so they are left untouched
+            if (filter::is_enabled() && filter::is_excluded(relativePath + entry.name, entry.name, true)) continue;
+
+            string path = destination + "/" + entry.name;
+
+            //if directory is empty, remove it
+            if (remove_empty_directories(path, relativePath + entry.name + "/") && directory_delete(path)) {
+                remainingEntries--;
+            }
+        }
+
+        filter::leave_directory(relativePath);
+        return remainingEntries == 0;
+    }
+
+    bool create_subdirectories(const string &path) {
+        string path_copy = path;
+        string path_to_create;
+
+        while (path_copy.find('/') != string::npos) {
+            //appending next directory to path, one by one
+            path_to_create += path_copy.substr(0, path_copy.find('/') + 1);
+
+            //removing already added directory from path
+            path_copy = path_copy.substr(path_copy.find('/') + 1);
+
+            //if directory already exists, then skip it
+            if (utils::is_a_directory(path_to_create)) {
+                continue;
+            }
+
+            //try to create directory
+            //if failed - we can't continue
+            if (!utils::directory_create(path_to_create)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //big files are copied by mmap_file_copy, which can be resumed from checkpoint
+    bool is_big_file(const FileInfo &file) {
+        return file.size > (size_t) settings::big_file_mb * 1024 * 1024;
+    }
+
+    bool file_copy(const FileInfo &source, const string &destination) {
+        //create subdirectories if needed
+        if (!create_subdirectories(destination)) {
+            log(Operation::FILE_OPERATION_ERROR, "Failed to create subdirectories for file " + source.path + " to " +
+                                                 destination + " due to " + strerror(errno) + " (errno: " +
+                                                 to_string(errno) +
+                                                 ")");
+            return false;
+        }
+
+        //check if size is bigger than 5MB
+        //if yes, then use mmap (resumable copy, modification time is changed before file is published)
+        //in other case use normal file copy
+        bool result;
+        if (is_big_file(source)) {
+            result = mmap_file_copy(source, destination);
+        } else if (settings::durable) {
+            //in durable mode file is published after durability barrier, so it is copied into part file
+            string partPath = get_part_file_path(destination);
+            result = read_write_file_copy(source.path, partPath);
+
+            vfs::FileStat partStat;
+            result = result && vfs::current->stat(partPath, partStat) &&
+                     publish_file({partPath, destination, "", partStat.device});
+        } else {
+            //modification time is set by copy, using open destination descriptor
+            result = read_write_file_copy(source.path, destination);
+        }
+
+        //copy interrupted by SIGTERM is logged by mmap_file_copy and resumed after restart
+        if (!result && !settings::daemon_awaiting_termination) {
+            log(Operation::FILE_OPERATION_ERROR,
+                "Failed to copy file " + source.path + " to " + destination + " due to " +
+                strerror(errno) + " (errno: " + to_string(errno) + ")");
+        }
+
+        return result;
+    }
+
+    //mirroredPath is inverse path to directory where files are synced
+    //work like mirror, for example:
+
+    //directory: /home/user/archive
+    //mirroredPath: /home/user/backup
+
+    //filePath: /home/user/archive/1/2/file.txt
+    //mirroredPath: /home/user/backup/1/2/file.txt
+
+    //recursivePathCollector is used to store path to directory where files are stored (help variable)
+
+    //sourceScan - if true, per directory filter rules are read from scanned directory and internal files are skipped
+    //otherwise (destination scan) rules loaded during source scan are reused and internal files are mirrored
+    //to file which they belong to, so they are removed together with it
+    //returns false if any directory couldn't be listed, files inside it are missing from files vector
+    bool scan_files_in_directory(const string &directory, bool recursive,
+                                 vector<FileInfo> &files, const string &mirroredPath, string &recursivePathCollector,
+                                 bool sourceScan = true) {
+        vector<vfs::DirectoryEntry> entries;
+        if (!vfs::current->list_directory(directory, entries)) {
+            log(FILE_OPERATION_ERROR, "Can't open directory " + directory + " due to error: " + strerror(errno));
+            return false;
+        }
+
+        bool complete = true;
+
+        filter::enter_directory(directory, recursivePathCollector, sourceScan);
+
+        //read all files and directories in current directory
+        //if recursive mode is enabled then call this function for each directory
+        for (const auto &entry: entries) {
+
+            //path with directory name and file name
+            string fullPath = directory + "/" + entry.name;
+
+            //check filter rules before stat, so excluded files are never stat'ed and excluded directories never opened
+            if (filter::is_enabled() &&
+                filter::is_excluded(recursivePathCollector + entry.name, entry.name, entry.isDirectory)) {
+                continue;
+            }
+
+            //if file is not directory then add it to files vector
+            if (!entry.isDirectory) {
+                bool internal = is_internal_file(entry.name);
+                if (internal && sourceScan) {
+                    continue;
+                }
+
+                //one stat per file, file removed after directory was listed is skipped
+                //file which can't be stat'ed for other reason is kept, so its mirror isn't deleted
+                vfs::FileStat file_stat;
+                bool statResult = vfs::current->stat(fullPath, file_stat);
+                if (!statResult && errno == ENOENT) continue;
+                if (!statResult) {
+                    log(FILE_OPERATION_ERROR, "Can't stat file " + fullPath + " due to error: " + strerror(errno));
+                }
+
+                FileInfo file_info;
+                file_info.path = fullPath;
+                file_info.mirrorPath = mirroredPath + "/" + recursivePathCollector +
+                                       (internal ? get_internal_file_target_name(entry.name) : entry.name);
+                file_info.lastModified = file_stat.lastModified;
+                file_info.size = file_stat.size;
+                file_info.unreadable = !statResult;
+                files.push_back(file_info);
+                continue;
+            }
+
+            //if recursive mode is disabled then skip directory
+            if (!recursive) {
+                continue;
+            }
+
+            //we are in recursive call and current file is directory
+            //so add directory name to recursivePathCollector and call this function recursively for this directory
+            recursivePathCollector += entry.name + "/";
+
+            complete &= scan_files_in_directory(fullPath, recursive, files, mirroredPath, recursivePathCollector,
+                                                sourceScan);
+
+            //exiting from recursive call, so remove last directory name from recursivePathCollector with `/` at the end
+            recursivePathCollector = recursivePathCollector.substr(0, recursivePathCollector.size() -
+                                                                      entry.name.size() - 1);
+        }
+
+        filter::leave_directory(recursivePathCollector);
+        return complete;
+    }
+}
+
+//point-in-time copies of destination directory, like
+//  /mnt/snapshots/2026-01-01_12-00-00/1/2/file.txt
+//files which weren't created or updated since previous snapshot are hardlinked from it,
+//only changed files are copied (reflinked if filesystem supports it), so snapshot costs scale with amount of changes
+namespace snapshot {
+    unordered_set<string> changed_files; //paths (relative to destination) of files copied since last snapshot
+    unordered_set<string> deleted_files; //paths (relative to destination) of files deleted since last snapshot
+
+    //changes made before daemon start are unknown, so first snapshot compares files with previous snapshot
+    bool previous_verified = false;
+    time_t last_snapshot_time = 0;
+
+    bool is_enabled() {
+        return !settings::snapshot_dir.empty();
+    }
+
+    string get_relative_path(const string &path, const string &root) {
+        return path.substr(root.size() + 1);
+    }
+
+    void mark_changed(const FileInfo &file, const string &destinationPath) {
+        if (!is_enabled()) return;
+        changed_files.insert(get_relative_path(file.mirrorPath, destinationPath));
+    }
+
+    //file - destination file removed because it no longer exists in source directory
+    void mark_deleted(const FileInfo &file, const string &destinationPath) {
+        if (!is_enabled()) return;
+        deleted_files.insert(get_relative_path(file.path, destinationPath));
+    }
+
+    bool is_due() {
+        return time(nullptr) - last_snapshot_time >= settings::snapshot_interval;
+    }
+
+    //snapshot name is UTC timestamp in format YYYY-MM-DD_hh-mm-ss (like 2026-01-01_12-00-00)
+    //other entries of snapshot directory don't belong to daemon, they are never listed or removed
+    bool is_snapshot_name(const string &name) {
+        const string format = "0000-00-00_00-00-00";
+        if (name.size() != format.size()) return false;
+
+        for (size_t i = 0; i < name.size(); i++) {
+            if (format[i] == '0' ? !isdigit((unsigned char) name[i]) : name[i] != format[i]) return false;
+        }
+        return true;
+    }
+
+    //snapshot names are UTC timestamps, so sorted names are sorted from oldest to newest
+    //directories starting with `.` are unfinished snapshots
+    vector<string> list_snapshots() {
+        vector<string> snapshots;
+        DIR *dir = opendir(settings::snapshot_dir.c_str());
+        if (dir == nullptr) return snapshots;
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (!is_snapshot_name(entry->d_name)) continue;
+            snapshots.emplace_back(entry->d_name);
+        }
+        closedir(dir);
+
+        sort(snapshots.begin(), snapshots.end());
+        return snapshots;
+    }
+
+    bool remove_tree(const string &path) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) return false;
+
+        bool result = true;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            string name = string(entry->d_name);
+            if (name == "." || name == "..") continue;
+
+            string entryPath = path + "/" + name;
+            if (utils::is_directory_entry(entry, entryPath)) {
+                result &= remove_tree(entryPath);
+            } else {
+                result &= unlink(entryPath.c_str()) == 0;
+            }
+        }
+        closedir(dir);
+
+        return rmdir(path.c_str()) == 0 && result;
+    }
+
+    //create parent directories of file inside snapshot, without logging every directory
+    bool create_parent_directories(const string &path, const string &root, string &lastCreated) {
+        string parent = path.substr(0, path.rfind('/'));
+        if (parent == lastCreated) return true;
+
+        for (size_t slash = parent.find('/', root.size() + 1); ; slash = parent.find('/', slash + 1)) {
+            string directory = parent.substr(0, slash);
+            if (mkdir(directory.c_str(), 0777) == -1 && errno != EEXIST) {
+                return false;
+            }
+            if (slash == string::npos) break;
+        }
+
+        lastCreated = parent;
+        return true;
+    }
+
+    bool count_files(const string &path, size_t &count) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) return false;
+
+        bool result = true;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            string name = string(entry->d_name);
+            if (name == "." || name == "..") continue;
+
+            string entryPath = path + "/" + name;
+            if (utils::is_directory_entry(entry, entryPath)) {
+                result &= count_files(entryPath, count);
+            } else {
+                count++;
+            }
+        }
+        closedir(dir);
+
+        return result;
+    }
+
+    bool is_unchanged(const string &previousPath, const FileInfo &file, const string &relativePath) {
+        if (changed_files.count(relativePath) != 0) return false;
+        if (previous_verified) return true;
+
+        //same check as daemon uses to compare source and destination
+        struct stat previousStat{};
+        if (stat(previousPath.c_str(), &previousStat) == -1) return false;
+        return (size_t) previousStat.st_size == file.size && utils::is_same_time(previousStat.st_mtim, file.lastModified);
+    }
+
+    //snapshot equal to previous one would only repeat its directory tree and hardlinks, so it isn't created
+    bool has_changes(const string &previousPath, const vector<FileInfo> &files, const string &destinationPath) {
+        if (!changed_files.empty() || !deleted_files.empty()) return true;
+        if (previous_verified) return false;
+
+        for (const auto &file: files) {
+            string relativePath = get_relative_path(file.mirrorPath, destinationPath);
+            if (!is_unchanged(previousPath + "/" + relativePath, file, relativePath)) return true;
+        }
+
+        //files deleted while daemon wasn't running are still in previous snapshot
+        size_t previousCount = 0;
+        return !count_files(previousPath, previousCount) || previousCount != files.size();
+    }
+
+    //copy file into snapshot, reflinked if filesystem supports it
+    //metadata is copied from destination file, like in synchronization copy
+    bool materialize(const string &source, const string &target) {
+        int sourceFd = vfs::current->open(source, O_RDONLY);
+        if (sourceFd == -1) return false;
+
+        vfs::FileStat sourceStat;
+        if (!vfs::current->fstat(sourceFd, sourceStat)) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+
+        int targetFd = vfs::current->open(target, O_WRONLY | O_CREAT | O_TRUNC);
+        if (targetFd == -1) {
+            vfs::current->close(sourceFd);
+            return false;
+        }
+
+        bool result = vfs::current->copy_content(sourceFd, targetFd) &&
+                      utils::copy_metadata(sourceFd, sourceStat, targetFd, target);
+        vfs::current->close(sourceFd);
+        vfs::current->close(targetFd);
+        return result;
+    }
+
+    //remove oldest snapshots above retention limit and unfinished snapshots left after crash
+    void prune() {
+        vector<string> snapshots = list_snapshots();
+        for (size_t i = 0; i + settings::snapshot_keep < snapshots.size(); i++) {
+            string path = settings::snapshot_dir + "/" + snapshots[i];
+            if (remove_tree(path)) {
+                utils::log(FILE_OPERATION_INFO, "Snapshot " + path + " removed");
+            } else {
+                utils::log(FILE_OPERATION_ERROR, "Snapshot " + path + " remove failed due to " + strerror(errno));
+            }
+        }
+
+        DIR *dir = opendir(settings::snapshot_dir.c_str());
+        if (dir == nullptr) return;
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            //unfinished snapshot: .<snapshot name>.fsd-part
+            string name = string(entry->d_name);
+            size_t suffixSize = strlen(PART_FILE_SUFFIX);
+            if (name[0] == '.' && utils::string_ends_with(name, PART_FILE_SUFFIX) && name.size() > suffixSize &&
+                is_snapshot_name(name.substr(1, name.size() - suffixSize - 1))) {
+                remove_tree(settings::snapshot_dir + "/" + name);
+            }
+        }
+        closedir(dir);
+    }
+
+    //files - synchronized source files, their mirror paths point to destination directory
+    bool create(const string &destinationPath, const vector<FileInfo> &files) {
+        ostringstream oss;
+        time_t now = time(nullptr);
+        //UTC time doesn't go backwards when daylight saving time ends, so names keep chronological order
+        oss << put_time(gmtime(&now), "%Y-%m-%d_%H-%M-%S");
+        string name = oss.str();
+
+        vector<string> snapshots = list_snapshots();
+        string previousPath = snapshots.empty() ? "" : settings::snapshot_dir + "/" + snapshots.back();
+
+        if (!previousPath.empty() && !has_changes(previousPath, files, destinationPath)) {
+            //logged once, later iterations without changes skip snapshot silently
+            if (!previous_verified) {
+                utils::log(DAEMON_WORK_INFO, "Nothing changed since snapshot " + previousPath + ", snapshot skipped");
+            }
+            previous_verified = true;
+            return true;
+        }
+
+        string snapshotPath = settings::snapshot_dir + "/" + name;
+        if (utils::is_file_or_directory_exists(snapshotPath)) {
+            utils::log(DAEMON_WORK_INFO, "Snapshot " + snapshotPath + " already exists, skipping");
+            return false;
+        }
+
+        //snapshot is created in hidden directory and renamed when finished, so it is never seen partially created
+        string workPath = settings::snapshot_dir + "/." + name + PART_FILE_SUFFIX;
+        if (mkdir(workPath.c_str(), 0777) == -1) {
+            utils::log(FILE_OPERATION_ERROR, "Snapshot directory " + workPath + " creation failed due to " +
+                                             strerror(errno));
+            return false;
+        }
+
+        size_t linked = 0, materialized = 0;
+        string lastCreated;
+        bool result = true;
+        for (const auto &file: files) {
+            string relativePath = get_relative_path(file.mirrorPath, destinationPath);
+            string target = workPath + "/" + relativePath;
+            string previous = previousPath + "/" + relativePath;
+
+            if (!create_parent_directories(target, workPath, lastCreated)) {
+                result = false;
+                break;
+            }
+
+            if (!previousPath.empty() && is_unchanged(previous, file, relativePath) &&
+                link(previous.c_str(), target.c_str()) == 0) {
+                linked++;
+                continue;
+            }
+
+            //file is new, changed or can't be linked (for example link count limit)
+            if (!materialize(file.mirrorPath, target)) {
+                result = false;
+                break;
+            }
+            materialized++;
+        }
+
+        if (!result || rename(workPath.c_str(), snapshotPath.c_str()) == -1) {
+            utils::log(FILE_OPERATION_ERROR, "Snapshot " + snapshotPath + " creation failed due to " +
+                                             strerror(errno));
+            remove_tree(workPath);
+            return false;
+        }
+
+        changed_files.clear();
+        deleted_files.clear();
+        previous_verified = true;
+        last_snapshot_time = now;
+        utils::log(DAEMON_WORK_INFO, "Snapshot " + snapshotPath + " created, " + to_string(linked) +
+                                     " files linked and " + to_string(materialized) + " files copied");
+
+        prune();
+        return true;
+    }
+}
+
+//alternative destination backend, enabled with --chunk-store
+//files are split into content-defined chunks (FastCDC with gear rolling hash), every unique chunk is stored once:
+//  /mnt/backup/chunks/3f/3fa2...c1        - chunk content, name is SHA-256 of content
+//  /mnt/backup/files/1/2/file.txt         - recipe, list of chunks which are concatenated into file
+//near-duplicate files share most of their chunks, so only changed chunks are written
+//plain directory tree can be rebuilt with --export command
+namespace chunkstore {
+
+    //chunk size limits, chunk boundary is found between MIN and MAX, average chunk size is close to AVG
+    const size_t MIN_CHUNK_SIZE = 16 * 1024;
+    const size_t AVG_CHUNK_SIZE = 64 * 1024;
+    const size_t MAX_CHUNK_SIZE = 256 * 1024;
+
+    //normalized chunking - harder to cut before average size, easier after it
+    //gear hash is shifted left, so highest bits depend on most recent bytes
+    const uint64_t MASK_SMALL = ((1ULL << 18) - 1) << (64 - 18);
+    const uint64_t MASK_LARGE = ((1ULL << 14) - 1) << (64 - 14);
+
+    //recipe header, followed by line with source size and modification time (version 1 - seconds only)
+    const string RECIPE_HEADER = "FSDRECIPE 2";
+    const string RECIPE_HEADER_V1 = "FSDRECIPE 1";
+
+    string store_root; //destination directory with chunks and files directories
+
+    unordered_set<string> written_chunks; //chunks written (or found) in current iteration
+    size_t known_failed_commits = 0; //utils::failed_commits when written_chunks was last verified
+    bool needs_collection = false; //true if some recipe was removed or replaced, so chunks could be unused
+    size_t stored_bytes = 0; //bytes of new chunks written in current iteration
+    size_t deduplicated_bytes = 0; //bytes of chunks which were already stored
+
+    string get_recipes_path(const string &root) {
+        return root + "/files";
+    }
+
+    string get_chunks_path(const string &root) {
+        return root + "/chunks";
+    }
+
+    string get_chunk_path(const string &hash) {
+        return get_chunks_path(store_root) + "/" + hash.substr(0, 2) + "/" + hash;
+    }
+
+    //<editor-fold desc="SHA-256">
+    const uint32_t SHA256_K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    uint32_t rotate_right(uint32_t value, int bits) {
+        return (value >> bits) | (value << (32 - bits));
+    }
+
+    void sha256_block(uint32_t state[8], const uint8_t *block) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t) block[i * 4] << 24 | (uint32_t) block[i * 4 + 1] << 16 |
+                   (uint32_t) block[i * 4 + 2] << 8 | (uint32_t) block[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotate_right(w[i - 15], 7) ^ rotate_right(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotate_right(w[i - 2], 17) ^ rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+            uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + SHA256_K[i] + w[i];
+            uint32_t s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+            uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+
+    //returns hex encoded SHA-256 of data
+    string sha256(const uint8_t *data, size_t size) {
+        uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                             0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+        size_t offset = 0;
+        for (; offset + 64 <= size; offset += 64) {
+            sha256_block(state, data + offset);
+        }
+
+        //padding: 0x80, zeros and message length in bits (big endian)
+        uint8_t tail[128] = {};
+        size_t rest = size - offset;
+        memcpy(tail, data + offset, rest);
+        tail[rest] = 0x80;
+        size_t tailSize = rest < 56 ? 64 : 128;
+        uint64_t bits = (uint64_t) size * 8;
+        for (int i = 0; i < 8; i++) {
+            tail[tailSize - 1 - i] = (uint8_t) (bits >> (i * 8));
+        }
+        for (size_t i = 0; i < tailSize; i += 64) {
+            sha256_block(state, tail + i);
+        }
+
+        char hex[65];
+        for (int i = 0; i < 8; i++) {
+            snprintf(hex + i * 8, 9, "%08x", state[i]);
+        }
+        return {hex, 64};
+    }
+    //</editor-fold>
+
+    //gear table, 256 pseudo random values (splitmix64 with fixed seed), must never change
+    //otherwise chunk boundaries of already stored files would change
+    const vector<uint64_t> &get_gear_table() {
+        static vector<uint64_t> table = [] {
+            vector<uint64_t> values(256);
+            uint64_t seed = 0x46696c6553796e63ULL;
+            for (auto &value: values) {
+                uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                value = z ^ (z >> 31);
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    //FastCDC, returns size of next chunk starting at data
+    size_t find_chunk_boundary(const uint8_t *data, size_t size) {
+        if (size <= MIN_CHUNK_SIZE) return size;
+
+        const vector<uint64_t> &gear = get_gear_table();
+        size_t normalSize = min(size, AVG_CHUNK_SIZE);
+        size_t maxSize = min(size, MAX_CHUNK_SIZE);
+        uint64_t hash = 0;
+
+        //first MIN_CHUNK_SIZE bytes can't contain boundary, so they are skipped
+        size_t i = MIN_CHUNK_SIZE;
+        for (; i < normalSize; i++) {
+            hash = (hash << 1) + gear[data[i]];
+            if ((hash & MASK_SMALL) == 0) return i + 1;
+        }
+        for (; i < maxSize; i++) {
+            hash = (hash << 1) + gear[data[i]];
+            if ((hash & MASK_LARGE) == 0) return i + 1;
+        }
+        return maxSize;
+    }
+
+    //write content into part file and publish it (in durable mode after durability barrier)
+    //failedCommits - see PendingFile, recipe is not published if any of its chunks wasn't published
+    bool write_file(const string &path, const uint8_t *data, size_t size, const timespec &lastModified,
+                    size_t failedCommits = SIZE_MAX) {
+        string partPath = utils::get_part_file_path(path);
+        int fd = open(partPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1) {
+            return false;
+        }
+
+        size_t offset = 0;
+        while (offset < size) {
+            ssize_t written = write(fd, data + offset, size - offset);
+            if (written <= 0) break;
+            offset += written;
+        }
+        utils::start_writeback(fd, 0, offset);
+
+        struct stat partStat{};
+        bool result = offset == size && fstat(fd, &partStat) == 0 &&
+                      utils::change_file_modification_time(fd, partPath, lastModified);
+        close(fd);
+
+        if (!result) {
+            utils::log(FILE_OPERATION_ERROR, "Can't write to file: " + partPath + " due to error: " + strerror(errno));
+            remove(partPath.c_str());
+            return false;
+        }
+        return utils::publish_file({partPath, path, "", partStat.st_dev, failedCommits});
+    }
+
+    bool store_chunk(const string &hash, const uint8_t *data, size_t size) {
+        if (written_chunks.count(hash) != 0) {
+            deduplicated_bytes += size;
+            return true;
+        }
+
+        string path = get_chunk_path(hash);
+        if (utils::is_file_or_directory_exists(path)) {
+            written_chunks.insert(hash);
+            deduplicated_bytes += size;
+            return true;
+        }
+
+        string directory = path.substr(0, path.rfind('/'));
+        if (mkdir(directory.c_str(), 0777) == -1 && errno != EEXIST) {
+            utils::log(FILE_OPERATION_ERROR, "Directory " + directory + " creation failed due to " + strerror(errno));
+            return false;
+        }
+
+        if (!write_file(path, data, size, {time(nullptr), 0})) {
+            return false;
+        }
+
+        written_chunks.insert(hash);
+        stored_bytes += size;
+        return true;
+    }
+
+    //split source file into chunks, store new chunks and write recipe
+    bool store_file(const FileInfo &source, const string &recipePath) {
+        //chunk which wasn't published could be remembered as written, so chunks are checked on disk again
+        if (utils::failed_commits != known_failed_commits) {
+            written_chunks.clear();
+            known_failed_commits = utils::failed_commits;
+        }
+        size_t failedCommits = utils::failed_commits;
+
+        if (!utils::create_subdirectories(recipePath)) {
+            utils::log(FILE_OPERATION_ERROR, "Failed to create subdirectories for recipe " + recipePath);
+            return false;
+        }
+
+        int sourceFd = open(source.path.c_str(), O_RDONLY);
+        if (sourceFd == -1) {
+            utils::log(FILE_OPERATION_ERROR, "Can't open file " + source.path + " due to error: " + strerror(errno));
+            return false;
+        }
+
+        //use current size and modification time, source could be modified after scan
+        struct stat sourceStat{};
+        if (fstat(sourceFd, &sourceStat) == -1) {
+            close(sourceFd);
+            return false;
+        }
+        size_t sourceSize = (size_t) sourceStat.st_size;
+
+        const uint8_t *sourceMap = nullptr;
+        if (sourceSize > 0) {
+            void *map = mmap(nullptr, sourceSize, PROT_READ, MAP_PRIVATE, sourceFd, 0);
+            if (map == MAP_FAILED) {
+                close(sourceFd);
+                return false;
+            }
+            madvise(map, sourceSize, MADV_SEQUENTIAL);
+            sourceMap = (const uint8_t *) map;
+        }
+        close(sourceFd);
+
+        string recipe = RECIPE_HEADER + "\n" + to_string(sourceSize) + " " + to_string(sourceStat.st_mtim.tv_sec) + " " +
+                        to_string(sourceStat.st_mtim.tv_nsec) + "\n";
+        bool result = true;
+        for (size_t offset = 0; offset < sourceSize;) {
+            size_t size = find_chunk_boundary(sourceMap + offset, sourceSize - offset);
+            string hash = sha256(sourceMap + offset, size);
+            if (!store_chunk(hash, sourceMap + offset, size)) {
+                result = false;
+                break;
+            }
+
+            recipe += hash + " " + to_string(size) + "\n";
+            offset += size;
+        }
+
+        if (sourceMap != nullptr) munmap((void *) sourceMap, sourceSize);
+        if (!result) {
+            return false;
+        }
+
+        //previous version of recipe could reference chunks which are not used anymore
+        if (utils::is_file_or_directory_exists(recipePath)) {
+            needs_collection = true;
+        }
+        return write_file(recipePath, (const uint8_t *) recipe.data(), recipe.size(), sourceStat.st_mtim,
+                          failedCommits);
+    }
+
+    //recipe header contains size and modification time of source file
+    //files stored with version 1 recipe have modification time without nanoseconds, so they are stored again
+    bool read_recipe_header(istream &file, size_t &size, timespec &lastModified) {
+        string header;
+        if (!getline(file, header) || (header != RECIPE_HEADER && header != RECIPE_HEADER_V1)) return false;
+
+        lastModified.tv_nsec = 0;
+        return (file >> size >> lastModified.tv_sec) && (header == RECIPE_HEADER_V1 || file >> lastModified.tv_nsec);
+    }
+
+    //recipe file size is not size of source file, so sizes (and modification times) are read from recipes
+    void load_recipe_headers(vector<FileInfo> &recipes) {
+        for (auto &recipe: recipes) {
+            size_t slash = recipe.path.rfind('/') + 1;
+            if (utils::is_internal_file(recipe.path.substr(slash))) continue;
+
+            ifstream file(recipe.path);
+            if (!read_recipe_header(file, recipe.size, recipe.lastModified)) {
+                //broken recipe will be replaced, because size doesn't match
+                recipe.size = SIZE_MAX;
+            }
+        }
+    }
+
+    //call callback for every recipe file inside directory (recursively)
+    template<typename Callback>
+    void for_each_recipe(const string &directory, const string &relativePath, Callback callback) {
+        DIR *dir = opendir(directory.c_str());
+        if (dir == nullptr) return;
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            string name = string(entry->d_name);
+            if (name == "." || name == "..") continue;
+
+            string path = directory + "/" + name;
+            if (utils::is_directory_entry(entry, path)) {
+                for_each_recipe(path, relativePath + name + "/", callback);
+            } else if (!utils::is_internal_file(name)) {
+                callback(path, relativePath + name);
+            }
+        }
+        closedir(dir);
+    }
+
+    //remove chunks which are not referenced by any recipe
+    void collect_garbage() {
+        unordered_set<string> referenced;
+        for_each_recipe(get_recipes_path(store_root), "", [&](const string &path, const string &) {
+            ifstream file(path);
+            string line;
+            getline(file, line);
+            getline(file, line);
+            while (getline(file, line)) {
+                referenced.insert(line.substr(0, line.find(' ')));
+            }
+        });
+
+        size_t removed = 0;
+        string chunksPath = get_chunks_path(store_root);
+        for_each_recipe(chunksPath, "", [&](const string &path, const string &relativePath) {
+            string hash = relativePath.substr(relativePath.find('/') + 1);
+            if (referenced.count(hash) != 0) return;
+
+            if (unlink(path.c_str()) == 0) {
+                written_chunks.erase(hash);
+                removed++;
+            }
+        });
+
+        needs_collection = false;
+        utils::log(DAEMON_WORK_INFO, "Chunk garbage collection finished, removed " + to_string(removed) + " chunks");
+    }
+
+    //log deduplication statistics and remove unused chunks
+    void finish_iteration() {
+        if (stored_bytes > 0 || deduplicated_bytes > 0) {
+            utils::log(DAEMON_WORK_INFO, "Chunk store: " + to_string(stored_bytes) + " bytes written, " +
+                                         to_string(deduplicated_bytes) + " bytes deduplicated");
+        }
+        stored_bytes = 0;
+        deduplicated_bytes = 0;
+        written_chunks.clear();
+
+        if (needs_collection) {
+            collect_garbage();
+        }
+    }
+
+    bool initialize(const string &destinationPath) {
+        store_root = destinationPath;
+        for (const auto &path: {get_recipes_path(destinationPath), get_chunks_path(destinationPath)}) {
+            if (!utils::is_a_directory(path) && mkdir(path.c_str(), 0777) == -1) {
+                utils::log(DAEMON_INIT_ERROR, "Directory " + path + " creation failed due to " + strerror(errno));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //rebuild plain directory tree from chunk store
+    bool export_tree(const string &storePath, const string &targetPath) {
+        store_root = storePath;
+        size_t exported = 0;
+        bool result = true;
+
+        for_each_recipe(get_recipes_path(storePath), "", [&](const string &recipePath, const string &relativePath) {
+            string target = targetPath + "/" + relativePath;
+            string partPath = utils::get_part_file_path(target);
+
+            ifstream recipe(recipePath);
+            size_t size = 0;
+            timespec lastModified{};
+            if (!read_recipe_header(recipe, size, lastModified) || !utils::create_subdirectories(target)) {
+                utils::log(FILE_OPERATION_ERROR, "Can't export recipe " + recipePath);
+                result = false;
+                return;
+            }
+
+            int fd = open(partPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd == -1) {
+                utils::log(FILE_OPERATION_ERROR, "Can't open file " + partPath + " due to error: " + strerror(errno));
+                result = false;
+                return;
+            }
+
+            //every chunk is verified, corrupted chunk store must not produce silently corrupted files
+            string hash;
+            size_t chunkSize, written = 0;
+            vector<uint8_t> buffer;
+            bool fileResult = true;
+            while (fileResult && recipe >> hash >> chunkSize) {
+                buffer.resize(chunkSize);
+                ifstream chunk(get_chunk_path(hash), ios::binary);
+                fileResult = chunk.read((char *) buffer.data(), (streamsize) chunkSize) &&
+                             sha256(buffer.data(), chunkSize) == hash &&
+                             write(fd, buffer.data(), chunkSize) == (ssize_t) chunkSize;
+                written += chunkSize;
+            }
+            fileResult = fileResult && written == size && utils::change_file_modification_time(fd, partPath, lastModified);
+            close(fd);
 
-    bool directory_create(const string &path) {
-        if (mkdir(path.c_str(), 0777) == 0) {
-            log(FILE_OPERATION_INFO, "Directory " + path + " created");
-            return true;
-        }
+            if (!fileResult || rename(partPath.c_str(), target.c_str()) == -1) {
+                utils::log(FILE_OPERATION_ERROR, "Can't export file " + target + ", chunk store is corrupted");
+                remove(partPath.c_str());
+                result = false;
+                return;
+            }
+            exported++;
+        });
 
-        log(FILE_OPERATION_ERROR, "Directory " + path + " creation failed due to " + strerror(errno));
-        return false;
+        utils::log(DAEMON_WORK_INFO, "Exported " + to_string(exported) + " files from " + storePath + " to " +
+                                     targetPath);
+        return result;
     }
+}
 
-    bool is_directory_empty(const string &path) {
-        DIR *dir = opendir(path.c_str());
-        if (dir == nullptr) {
-            log(FILE_OPERATION_ERROR, "Can't open directory " + path + " due to error: " + strerror(errno));
+namespace actions {
+
+    //copy file and remember it as changed for next snapshot
+    bool synchronize_file(const FileInfo &file, const string &destinationPath) {
+        bool result = settings::chunk_store ? chunkstore::store_file(file, file.mirrorPath)
+                                            : utils::file_copy(file, file.mirrorPath);
+        if (!result) {
             return false;
         }
 
-        struct dirent *entry = readdir(dir);
-        closedir(dir);
-
-        //if entry is null, directory is empty
-        return entry == nullptr;
+        snapshot::mark_changed(file, destinationPath);
+        return true;
     }
 
-    void remove_empty_directories(const string &destination) {
-        //recursively remove empty directories inside destination directory
-        //loop over all directories inside destination directory
-
-        DIR *dir = opendir(destination.c_str());
-        if (dir == nullptr) {
-            log(FILE_OPERATION_ERROR, "Can't open directory " + destination + " due to error: " + strerror(errno));
-            return;
+    //copy small files of one source directory, destination directory is created and both directories are opened once
+    bool synchronize_directory(const vector<const FileInfo *> &files, const string &destinationPath) {
+        const string &sourcePath = files.front()->path;
+        const string &mirrorPath = files.front()->mirrorPath;
+        if (!utils::create_subdirectories(mirrorPath)) {
+            utils::log(Operation::FILE_OPERATION_ERROR, "Failed to create subdirectories for file " + sourcePath +
+                                                        " to " + mirrorPath + " due to " + strerror(errno));
+            return false;
         }
 
-        struct dirent *entry = readdir(dir);
-        //iterate over all files inside directory, if entry is directory call this function again (recursion)
-        while (entry != nullptr) {
-            string entryName = string(entry->d_name);
-            string path = destination + "/" + entry->d_name;
+        int sourceDirectoryFd = vfs::current->open_directory(sourcePath.substr(0, sourcePath.rfind('/')));
+        int destinationDirectoryFd = vfs::current->open_directory(mirrorPath.substr(0, mirrorPath.rfind('/')));
 
-            if (is_a_directory(path)) {
-                remove_empty_directories(path);
+        //device is needed only for durability barrier
+        vfs::FileStat destinationStat;
+        bool opened = sourceDirectoryFd != -1 && destinationDirectoryFd != -1 &&
+                      (!settings::durable || vfs::current->fstat(destinationDirectoryFd, destinationStat));
 
-                //if directory is empty, remove it
-                if (is_directory_empty(path)) {
-                    directory_delete(path);
-                }
+        bool synchronized = true;
+        for (const auto &file: files) {
+            if (settings::daemon_awaiting_termination) {
+                synchronized = false;
+                break;
+            }
+
+            //if directory can't be opened, files are copied using full paths
+            if (!opened) {
+                synchronized &= synchronize_file(*file, destinationPath);
+                continue;
             }
 
-            entry = readdir(dir);
+            if (!utils::small_file_copy(sourceDirectoryFd, destinationDirectoryFd, destinationStat.device, *file,
+                                        file->mirrorPath)) {
+                utils::log(Operation::FILE_OPERATION_ERROR,
+                           "Failed to copy file " + file->path + " to " + file->mirrorPath + " due to " +
+                           strerror(errno) + " (errno: " + to_string(errno) + ")");
+                synchronized = false;
+                continue;
+            }
+            snapshot::mark_changed(*file, destinationPath);
         }
-    }
 
-    bool create_subdirectories(const string &path) {
-        string path_copy = path;
-        string path_to_create;
+        if (sourceDirectoryFd != -1) vfs::current->close(sourceDirectoryFd);
+        if (destinationDirectoryFd != -1) vfs::current->close(destinationDirectoryFd);
+        return synchronized;
+    }
 
-        while (path_copy.find('/') != string::npos) {
-            //appending next directory to path, one by one
-            path_to_create += path_copy.substr(0, path_copy.find('/') + 1);
+    //small files are grouped by directory and copied by synchronize_directory
+    //big files (and all files in chunk store mode) are copied one by one
+    bool synchronize_files(const vector<const FileInfo *> &files, const string &destinationPath) {
+        bool synchronized = true;
+        vector<vector<const FileInfo *>> directories;
+        unordered_map<string, size_t> directoryIndexes; //source directory path -> index in directories
 
-            //removing already added directory from path
-            path_copy = path_copy.substr(path_copy.find('/') + 1);
+        for (const auto &file: files) {
+            if (settings::daemon_awaiting_termination) break;
 
-            //if directory already exists, then skip it
-            if (utils::is_a_directory(path_to_create)) {
+            if (settings::chunk_store || file->size > SMALL_FILE_SIZE || utils::is_big_file(*file)) {
+                synchronized &= synchronize_file(*file, destinationPath);
                 continue;
             }
 
-            //try to create directory
-            //if failed - we can't continue
-            if (!utils::directory_create(path_to_create)) {
-                return false;
+            auto directory = directoryIndexes.emplace(file->path.substr(0, file->path.rfind('/')), directories.size());
+            if (directory.second) {
+                directories.emplace_back();
             }
+            directories[directory.first->second].push_back(file);
         }
-        return true;
-    }
 
-    size_t get_file_size(const string &path) {
-        struct stat file_stat{};
-        if (stat(path.c_str(), &file_stat) == -1) {
-            log(FILE_OPERATION_ERROR, "Can't get file size for " + path + " due to error: " + strerror(errno));
-            return 0;
+        for (const auto &directoryFiles: directories) {
+            if (settings::daemon_awaiting_termination) break;
+            synchronized &= synchronize_directory(directoryFiles, destinationPath);
         }
 
-        return (size_t) file_stat.st_size;
-    }
-
-    bool file_copy(const FileInfo &source, const string &destination) {
-        //create subdirectories if needed
-        if (!create_subdirectories(destination)) {
-            log(Operation::FILE_OPERATION_ERROR, "Failed to create subdirectories for file " + source.path + " to " +
-                                                 destination + " due to " + strerror(errno) + " (errno: " +
-                                                 to_string(errno) +
-                                                 ")");
+        //after SIGTERM remaining files aren't copied, they are synchronized after restart
+        if (settings::daemon_awaiting_termination) {
+            utils::log(Operation::DAEMON_WORK_INFO, "Daemon awaiting termination, remaining files are not copied");
             return false;
         }
+        return synchronized;
+    }
 
-        //check if size is bigger than 5MB
-        //if yes, then use mmap
-        //in other case use normal file copy
-        bool result;
-        if (source.size > settings::big_file_mb * 1024 * 1024) {
-            result = mmap_file_copy(source, destination);
-        } else {
-            result = read_write_file_copy(source.path, destination);
+    //publish pending files and create snapshot if iteration finished without errors
+    void finish_iteration(const string &destinationPath, const vector<FileInfo> &sourceFiles, bool synchronized) {
+        //publish files copied since last durability barrier (durable mode only)
+        synchronized &= utils::commit_pending_files();
+        if (settings::chunk_store) {
+            chunkstore::finish_iteration();
         }
 
-        //if copy was successful, then change modification time
-        if (result) {
-            change_file_modification_time(destination, source.lastModified);
-        } else {
-            log(Operation::FILE_OPERATION_ERROR,
-                "Failed to copy file " + source.path + " to " + destination + " due to " +
-                strerror(errno) + " (errno: " + to_string(errno) + ")");
+        if (!snapshot::is_enabled() || !snapshot::is_due()) return;
+        if (!synchronized) {
+            utils::log(Operation::DAEMON_WORK_INFO, "Some files were not synchronized, snapshot skipped");
+            return;
         }
 
-        return result;
+        snapshot::create(destinationPath, sourceFiles);
     }
 
-    //mirroredPath is inverse path to directory where files are synced
-    //work like mirror, for example:
+    //single synchronization pass, compare source and destination directories and copy or delete files
+    //returns true if all files were synchronized successfully
+    bool synchronize(const string &sourcePath, const string &destinationPath) {
+        //in chunk store mode source files are mirrored to recipes
+        const string mirrorPath = settings::chunk_store ? chunkstore::get_recipes_path(destinationPath)
+                                                        : destinationPath;
+
+        vector<FileInfo> sourceDirFiles = {};
+        vector<FileInfo> destinationDirFiles = {};
+        string recursivePathCollector; //used to collect path to file in recursive mode, only used as help variable
+
+        filter::reset_directory_rules();
+        //if some source directory couldn't be listed, its files are unknown (not removed)
+        //so nothing can be deleted from destination in this iteration
+        bool sourceScanComplete = utils::scan_files_in_directory(sourcePath, settings::recursive, sourceDirFiles,
+                                                                 mirrorPath, recursivePathCollector);
+
+        //check if source directory is empty
+        //if so, skip this iteration
+        if (sourceDirFiles.empty()) {
+            utils::log(Operation::DAEMON_SLEEP, "No files found in source directory");
+            return sourceScanComplete;
+        }
 
-    //directory: /home/user/archive
-    //mirroredPath: /home/user/backup
+        utils::scan_files_in_directory(mirrorPath, settings::recursive, destinationDirFiles, sourcePath,
+                                       recursivePathCollector, false);
+        if (settings::chunk_store) {
+            chunkstore::load_recipe_headers(destinationDirFiles);
+        }
 
-    //filePath: /home/user/archive/1/2/file.txt
-    //mirroredPath: /home/user/backup/1/2/file.txt
+        utils::log(Operation::DAEMON_WORK_INFO, "Scanning directories finished, found " +
+                                                to_string(sourceDirFiles.size()) +
+                                                " files in source directory and " +
+                                                to_string(destinationDirFiles.size()) +
+                                                " files in destination directory");
+        if (settings::debug) {
+            cout << "Source directory files: \n";
+            for (const auto &item: sourceDirFiles) {
+                cout << "Full path: " << item.path << "\nMirrored path: " << item.mirrorPath << "\nsize: "
+                     << item.size
+                     << "\nlast modified: " << utils::format_time(item.lastModified) << endl << endl;
+            }
 
-    //recursivePathCollector is used to store path to directory where files are stored (help variable)
-    void scan_files_in_directory(const string &directory, bool recursive,
-                                 vector<FileInfo> &files, const string &mirroredPath, string &recursivePathCollector) {
-        DIR *dir = opendir(directory.c_str());
-        if (dir == nullptr) return;
-        struct dirent *entry;
+            cout << "Destination directory files: \n";
+            for (const auto &item: destinationDirFiles) {
+                cout << "Full path: " << item.path << "\nMirrored path: " << item.mirrorPath << "\nsize: "
+                     << item.size
+                     << "\nlast modified: " << utils::format_time(item.lastModified) << endl << endl;
+            }
+        }
 
-        //read all files and directories in current directory
-        //if recursive mode is enabled then call this function for each directory
-        while ((entry = readdir(dir)) != nullptr) {
+        //both scans are indexed by path, so lookups don't touch filesystem and don't loop over all files
+        unordered_map<string, const FileInfo *> sourceFiles;
+        sourceFiles.reserve(sourceDirFiles.size());
+        for (const auto &file: sourceDirFiles) {
+            sourceFiles[file.path] = &file;
+        }
+
+        unordered_map<string, const FileInfo *> destinationFiles;
+        destinationFiles.reserve(destinationDirFiles.size());
+        for (const auto &file: destinationDirFiles) {
+            destinationFiles[file.path] = &file;
+        }
+
+        if (!sourceScanComplete) {
+            utils::log(Operation::DAEMON_WORK_INFO,
+                       "Source directory wasn't scanned completely, files in destination directory are not deleted");
+        }
+
+        //check if files in destination directory are not in source directory
+        //if so, delete them
+        for (const auto &file: destinationDirFiles) {
+            if (!sourceScanComplete) break;
+
+            //mirror path corresponds to source directory file
+            //if file in destination directory is not in source directory, delete it
+            auto sourceFile = sourceFiles.find(file.mirrorPath);
+            if (sourceFile != sourceFiles.end()) {
+                //part and checkpoint files are kept only while copy of their source file can be resumed
+                //(source became small, so it is copied directly, or part file was left by other copy)
+                const FileInfo &source = *sourceFile->second;
+                if (!utils::is_internal_file(file.path.substr(file.path.rfind('/') + 1)) ||
+                    (!settings::chunk_store && (source.unreadable || utils::is_big_file(source)))) {
+                    continue;
+                }
 
-            //skip hidden files and directories
-            if (string(entry->d_name) == "." || string(entry->d_name) == "..") {
+                utils::log(Operation::DAEMON_WORK_INFO, "File " + file.path + " can't be resumed, deleting");
+                utils::file_delete(file.path);
                 continue;
             }
 
-            //path with directory name and file name
-            string fullPath = directory + "/" + string(entry->d_name);
+            //file not found in source directory, delete it
+            utils::log(Operation::DAEMON_WORK_INFO,
+                       "File " + file.path + " not found in source directory, deleting");
+            utils::file_delete(file.path);
+            snapshot::mark_deleted(file, destinationPath);
+            destinationFiles.erase(file.path);
+            if (settings::chunk_store) chunkstore::needs_collection = true;
+        }
 
-            //if file is not directory then add it to files vector
-            if (!is_a_directory(fullPath)) {
-                FileInfo file_info;
-                file_info.path = fullPath;
-                file_info.mirrorPath = mirroredPath + "/" + recursivePathCollector + string(entry->d_name);
-                file_info.lastModified = get_file_modification_time(fullPath);
-                file_info.size = get_file_size(fullPath);
-                files.push_back(file_info);
+        //true if all files were copied successfully, snapshot is created only after successful iteration
+        bool synchronized = sourceScanComplete;
+        vector<const FileInfo *> changedFiles; //new and modified files, copied after comparison is finished
+
+        //check if destination directory is empty, if so, copy all files from source directory
+        if (destinationDirFiles.empty()) {
+            utils::log(Operation::DAEMON_WORK_INFO,
+                       "Destination directory is empty, copying all files from source directory");
+            for (const auto &file: sourceDirFiles) {
+                if (file.unreadable) {
+                    synchronized = false;
+                    continue;
+                }
+                changedFiles.push_back(&file);
+            }
+            synchronized &= synchronize_files(changedFiles, destinationPath);
+            finish_iteration(destinationPath, sourceDirFiles, synchronized);
+
+            utils::log(Operation::DAEMON_SLEEP, "Daemon finished work, counter reset");
+            return synchronized;
+        }
+
+        //check if files in source directory are already in destination directory
+        //if so, check if they are the same, if not, copy them
+        for (const auto &file: sourceDirFiles) {
+            //source file state is unknown, its copy in destination directory is left untouched until next iteration
+            if (file.unreadable) {
+                synchronized = false;
                 continue;
             }
 
-            //if recursive mode is disabled then skip directory
-            if (!recursive) {
+            //check if file is in destination directory, if not, copy it
+            auto destinationFile = destinationFiles.find(file.mirrorPath);
+            if (destinationFile == destinationFiles.end()) {
+                utils::log(Operation::DAEMON_WORK_INFO,
+                           "File " + file.path + " not found in destination directory, copying");
+                changedFiles.push_back(&file);
                 continue;
             }
 
-            //we are in recursive call and current file is directory
-            //so add directory name to recursivePathCollector and call this function recursively for this directory
-            recursivePathCollector += string(entry->d_name) + "/";
+            //check if files (source and destination) are the same
+            if (file.size != destinationFile->second->size ||
+                !utils::is_same_time(file.lastModified, destinationFile->second->lastModified)) {
+                utils::log(Operation::DAEMON_WORK_INFO, "File " + file.path +
+                                                        " is different in source and destination directory, replacing");
+                changedFiles.push_back(&file);
+            }
+        }
 
-            scan_files_in_directory(fullPath, recursive, files, mirroredPath, recursivePathCollector);
+        synchronized &= synchronize_files(changedFiles, destinationPath);
+        finish_iteration(destinationPath, sourceDirFiles, synchronized);
 
-            //exiting from recursive call, so remove last directory name from recursivePathCollector with `/` at the end
-            recursivePathCollector = recursivePathCollector.substr(0, recursivePathCollector.size() -
-                                                                      string(entry->d_name).size() - 1);
-        }
+        //check if after removing files from destination directory, there are no empty directories left
+        //if so, delete them
+        utils::remove_empty_directories(mirrorPath);
 
-        closedir(dir);
+        utils::log(Operation::DAEMON_SLEEP, "Daemon finished file synchronization");
+        return synchronized;
     }
-}
-
-namespace actions {
 
     //block thread for specified time until signal is received or time is up
     void handle_daemon_counter() {
@@ -456,9 +2994,16 @@ namespace actions {
     //--sleep_time=10 or -s=10
     //-R or --recursive
     //-d or --debug
-    //-B:5 or --big-file-size:5
+    //-B=5 or --big-file-size=5
+    //-F=<path> or --filter-file=<path>
+    //--per-directory-filter or --per-directory-filter=<name>
+    //-C=64 or --checkpoint-size=64
+    //--durable or --durable=1000
+    //--snapshot-dir=<path>, --snapshot-keep=24, --snapshot-interval=3600
+    //--chunk-store
     void handle_additional_args_parse(const string &arg) {
-        if (utils::string_contain(arg, "--sleep-time") || utils::string_contain(arg, "-s")) {
+        if (utils::string_starts_with(arg, "--sleep-time=") || utils::string_starts_with(arg, "--sleep_time=") ||
+            utils::string_starts_with(arg, "-s=")) {
             try {
                 string sleep_time_str = arg.substr(arg.find('=') + 1);
                 settings::sleep_time = stoi(sleep_time_str);
@@ -479,12 +3024,29 @@ namespace actions {
             utils::log(Operation::DAEMON_INIT, "Recursive mode enabled");
         }
 
+        if (arg == "--once") {
+            settings::once = true;
+            utils::log(Operation::DAEMON_INIT, "Single synchronization mode enabled");
+        }
+
         if (arg == "--debug" || arg == "-d") {
             settings::debug = true;
             utils::log(Operation::DAEMON_INIT, "Debug mode enabled using arg flag");
         }
 
-        if (utils::string_contain(arg, "--big-file-size") || utils::string_contain(arg, "-B")) {
+        if (utils::string_starts_with(arg, "-F=") || utils::string_starts_with(arg, "--filter-file=")) {
+            settings::filter_file = arg.substr(arg.find('=') + 1);
+            utils::log(Operation::DAEMON_INIT, "Filter rules file: " + settings::filter_file);
+        }
+
+        if (arg == "--per-directory-filter" || utils::string_starts_with(arg, "--per-directory-filter=")) {
+            settings::directory_filter_name = arg == "--per-directory-filter" ? ".syncignore" : arg.substr(
+                    arg.find('=') + 1);
+            utils::log(Operation::DAEMON_INIT,
+                       "Per directory filter rules enabled, rules file name: " + settings::directory_filter_name);
+        }
+
+        if (utils::string_starts_with(arg, "--big-file-size=") || utils::string_starts_with(arg, "-B=")) {
             try {
                 string sleep_time_str = arg.substr(arg.find('=') + 1);
                 settings::big_file_mb = stoi(sleep_time_str);
@@ -498,6 +3060,114 @@ namespace actions {
                 exit(-1);
             }
         }
+
+        if (arg == "--durable" || utils::string_starts_with(arg, "--durable=")) {
+            settings::durable = true;
+            try {
+                if (arg != "--durable") settings::durable_batch = stoi(arg.substr(arg.find('=') + 1));
+                if (settings::durable_batch <= 0) throw invalid_argument("batch size must be positive");
+
+                utils::log(Operation::DAEMON_INIT,
+                           "Durable mode enabled, batch size: " + to_string(settings::durable_batch) + " files");
+            } catch (exception &e) {
+                cerr << "Failed to parse durable batch size parameter " << arg << " due to: " << e.what() << endl;
+                utils::log(Operation::DAEMON_INIT_ERROR,
+                           "Failed to parse durable batch size parameter " + arg + " due to: " + e.what());
+                exit(-1);
+            }
+        }
+
+        if (utils::string_starts_with(arg, "--preserve=")) {
+            stringstream attributes(arg.substr(arg.find('=') + 1));
+            string attribute;
+            while (getline(attributes, attribute, ',')) {
+                if (attribute == "mode") {
+                    settings::preserve_mode = true;
+                } else if (attribute == "owner") {
+                    settings::preserve_owner = true;
+                } else if (attribute == "xattr") {
+                    settings::preserve_xattr = true;
+                } else {
+                    cerr << "Failed to parse preserve parameter " << arg << " due to unknown attribute " << attribute
+                         << endl;
+                    utils::log(Operation::DAEMON_INIT_ERROR,
+                               "Failed to parse preserve parameter " + arg + " due to unknown attribute " + attribute);
+                    exit(-1);
+                }
+            }
+            utils::log(Operation::DAEMON_INIT, "Preserved metadata: " + arg.substr(arg.find('=') + 1));
+        }
+
+        if (arg == "--chunk-store") {
+            settings::chunk_store = true;
+            utils::log(Operation::DAEMON_INIT, "Chunk store mode enabled");
+        }
+
+        if (utils::string_starts_with(arg, "--snapshot-dir=")) {
+            settings::snapshot_dir = arg.substr(arg.find('=') + 1);
+            utils::log(Operation::DAEMON_INIT, "Snapshots enabled, snapshot directory: " + settings::snapshot_dir);
+        }
+
+        if (utils::string_starts_with(arg, "--snapshot-keep=") || utils::string_starts_with(arg, "--snapshot-interval=")) {
+            try {
+                int value = stoi(arg.substr(arg.find('=') + 1));
+                if (utils::string_starts_with(arg, "--snapshot-keep=")) {
+                    if (value <= 0) throw invalid_argument("number of kept snapshots must be positive");
+                    settings::snapshot_keep = value;
+                } else {
+                    if (value < 0) throw invalid_argument("snapshot interval can't be negative");
+                    settings::snapshot_interval = value;
+                }
+
+                utils::log(Operation::DAEMON_INIT, "Custom snapshot parameter: " + arg);
+            } catch (exception &e) {
+                cerr << "Failed to parse snapshot parameter " << arg << " due to: " << e.what() << endl;
+                utils::log(Operation::DAEMON_INIT_ERROR,
+                           "Failed to parse snapshot parameter " + arg + " due to: " + e.what());
+                exit(-1);
+            }
+        }
+
+        if (utils::string_starts_with(arg, "--checkpoint-size=") || utils::string_starts_with(arg, "-C=")) {
+            try {
+                settings::checkpoint_mb = stoi(arg.substr(arg.find('=') + 1));
+                if (settings::checkpoint_mb <= 0) throw invalid_argument("checkpoint size must be positive");
+
+                utils::log(Operation::DAEMON_INIT,
+                           "Custom checkpoint size: " + to_string(settings::checkpoint_mb) + " MB");
+            } catch (exception &e) {
+                cerr << "Failed to parse checkpoint size parameter " << arg << " due to: " << e.what() << endl;
+                utils::log(Operation::DAEMON_INIT_ERROR,
+                           "Failed to parse checkpoint size parameter " + arg + " due to: " + e.what());
+                exit(-1);
+            }
+        }
+    }
+
+    bool validate_snapshot_dir(const string &sourcePath, const string &destinationPath) {
+        if (!utils::is_a_directory(settings::snapshot_dir)) {
+            cerr << "Snapshot path " << settings::snapshot_dir << " is not a directory" << endl;
+            utils::log(Operation::DAEMON_INIT_ERROR, "Snapshot path " + settings::snapshot_dir + " is not a directory");
+            return false;
+        }
+
+        char *snapshotRealPath = realpath(settings::snapshot_dir.c_str(), nullptr);
+        string snapshotPath = string(snapshotRealPath) + "/";
+        free(snapshotRealPath);
+
+        for (const auto &path: {sourcePath, destinationPath}) {
+            char *realPath = realpath(path.c_str(), nullptr);
+            bool inside = utils::string_starts_with(snapshotPath, string(realPath) + "/");
+            free(realPath);
+
+            if (inside) {
+                cerr << "Snapshot path " << settings::snapshot_dir << " is inside " << path << endl;
+                utils::log(Operation::DAEMON_INIT_ERROR, "Snapshot path " + settings::snapshot_dir + " is inside " + path);
+                return false;
+            }
+        }
+
+        return true;
     }
 
     bool validate_input_dirs(const string &sourcePath, const string &destinationPath) {
@@ -563,10 +3233,6 @@ namespace handlers {
     //But C++ expertise will ease the load.
     [[noreturn]] void daemon_handler(const string &sourcePath, const string &destinationPath) {
         while (true) {
-            vector<FileInfo> sourceDirFiles = {};
-            vector<FileInfo> destinationDirFiles = {};
-            string recursivePathCollector; //used to collect path to file in recursive mode, only used as help variable
-
             //check if daemon is awaiting termination
             if (settings::daemon_awaiting_termination) {
                 utils::log(Operation::DAEMON_WORK_INFO, "Daemon awaiting termination - exiting");
@@ -578,102 +3244,207 @@ namespace handlers {
             actions::handle_daemon_counter();
             settings::daemon_busy = true;
 
-            utils::scan_files_in_directory(sourcePath, settings::recursive, sourceDirFiles, destinationPath,
-                                           recursivePathCollector);
+            actions::synchronize(sourcePath, destinationPath);
 
-            //check if source directory is empty
-            //if so, skip this iteration
-            if (sourceDirFiles.empty()) {
-                utils::log(Operation::DAEMON_SLEEP, "No files found in source directory");
-                settings::daemon_busy = false;
-                continue;
-            }
+            //reset daemon busy flag
+            settings::daemon_busy = false;
+        }
+    }
+}
 
-            utils::scan_files_in_directory(destinationPath, settings::recursive, destinationDirFiles, sourcePath,
-                                           recursivePathCollector);
-
-            utils::log(Operation::DAEMON_WORK_INFO, "Scanning directories finished, found " +
-                                                    to_string(sourceDirFiles.size()) +
-                                                    " files in source directory and " +
-                                                    to_string(destinationDirFiles.size()) +
-                                                    " files in destination directory");
-            if (settings::debug) {
-                cout << "Source directory files: \n";
-                for (const auto &item: sourceDirFiles) {
-                    cout << "Full path: " << item.path << "\nMirrored path: " << item.mirrorPath << "\nsize: "
-                         << item.size
-                         << "\nlast modified: " << item.lastModified << endl << endl;
-                }
+//synchronization engine running on in-memory filesystem (vfs::MemoryFileSystem), used for benchmarks and fuzzing
+//source tree is generated and modified between cycles, latency and faults are injected only while engine works
+//after every cycle destination is compared with source, last cycle runs without faults and must converge
+//  Demon --simulate --sim-files=1000000 --sim-cycles=5 --sim-churn=0.01 --sim-read-error-rate=0.001
+namespace simulation {
+    struct Parameters {
+        size_t files = 10000; //number of files in source tree before first cycle
+        int cycles = 5; //number of cycles with faults, one fault free cycle is added at the end
+        double churn = 0.01; //part of files modified, created or deleted before every cycle
+        uint64_t seed = 1;
+        size_t fileSize = 4096; //average file size in bytes
+        vfs::FaultModel faults;
+    };
+
+    Parameters parameters;
+
+    //64 files per directory, 32 subdirectories per directory
+    string get_relative_path(size_t index) {
+        string path = "/f" + to_string(index);
+        for (size_t directory = index / 64; directory > 0; directory /= 32) {
+            path = "/d" + to_string(directory % 32) + path;
+        }
+        return path;
+    }
 
-                cout << "Destination directory files: \n";
-                for (const auto &item: destinationDirFiles) {
-                    cout << "Full path: " << item.path << "\nMirrored path: " << item.mirrorPath << "\nsize: "
-                         << item.size
-                         << "\nlast modified: " << item.lastModified << endl << endl;
-                }
-            }
+    //create or replace file with random content and metadata
+    void generate_file(vfs::MemoryFileSystem &filesystem, const string &path, mt19937_64 &random) {
+        string data(uniform_int_distribution<size_t>(0, parameters.fileSize * 2)(random), '\0');
+        for (auto &c: data) {
+            c = (char) random();
+        }
+        filesystem.put_file(path, data, filesystem.clock);
+
+        vfs::MemoryFileSystem::Node *node = filesystem.find(path);
+        const mode_t modes[] = {0600, 0644, 0755};
+        node->mode = modes[random() % 3];
+        node->owner = node->group = 1000 + random() % 4;
+        node->attributes.clear();
+        if (random() % 4 == 0) {
+            node->attributes["user.simulation"] = to_string(random());
+        }
+    }
 
-            //check if files in destination directory are not in source directory
-            //if so, delete them
-            for (const auto &file: destinationDirFiles) {
-                //mirror path corresponds to source directory file
-                //if file in destination directory is not in source directory, delete it
-                if (utils::is_file_or_directory_exists(file.mirrorPath)) continue;
+    //metadata is compared only if it is preserved
+    bool is_same_file(const vfs::MemoryFileSystem::Node &source, const vfs::MemoryFileSystem::Node &destination) {
+        return destination.data == source.data &&
+               utils::is_same_time(destination.lastModified, source.lastModified) &&
+               (!settings::preserve_mode || destination.mode == source.mode) &&
+               (!settings::preserve_owner || (destination.owner == source.owner && destination.group == source.group)) &&
+               (!settings::preserve_xattr || destination.attributes == source.attributes);
+    }
 
-                //file not found in source directory, delete it
-                utils::log(Operation::DAEMON_WORK_INFO,
-                           "File " + file.path + " not found in source directory, deleting");
-                utils::file_delete(file.path);
+    //count files in destination tree which don't exist in source tree
+    size_t count_extra_files(vfs::MemoryFileSystem &filesystem, const string &destination, const string &source) {
+        vfs::MemoryFileSystem::Node *node = filesystem.find(destination);
+        if (node == nullptr) return 0;
+
+        size_t extra = 0;
+        for (const auto &name: node->children) {
+            vfs::MemoryFileSystem::Node *child = filesystem.find(destination + "/" + name);
+            if (child->isDirectory) {
+                extra += count_extra_files(filesystem, destination + "/" + name, source + "/" + name);
+            } else if (!utils::is_internal_file(name) && filesystem.find(source + "/" + name) == nullptr) {
+                extra++;
             }
+        }
+        return extra;
+    }
 
-            //check if destination directory is empty, if so, copy all files from source directory
-            if (destinationDirFiles.empty()) {
-                utils::log(Operation::DAEMON_WORK_INFO,
-                           "Destination directory is empty, copying all files from source directory");
-                for (const auto &file: sourceDirFiles) {
-                    utils::file_copy(file, file.mirrorPath);
-                }
+    //number of missing, different and extra files in destination
+    size_t verify(vfs::MemoryFileSystem &filesystem, const vector<size_t> &liveFiles) {
+        size_t mismatches = 0;
+        for (size_t index: liveFiles) {
+            string path = get_relative_path(index);
+            vfs::MemoryFileSystem::Node *source = filesystem.find("/src" + path);
+            vfs::MemoryFileSystem::Node *destination = filesystem.find("/dst" + path);
+            if (destination == nullptr || !is_same_file(*source, *destination)) {
+                mismatches++;
+            }
+        }
+        return mismatches + count_extra_files(filesystem, "/dst", "/src");
+    }
 
-                settings::daemon_busy = false;
-                utils::log(Operation::DAEMON_SLEEP, "Daemon finished work, counter reset");
+    //modify, create and delete random files in source tree
+    void apply_churn(vfs::MemoryFileSystem &filesystem, vector<size_t> &liveFiles, size_t &nextIndex,
+                     mt19937_64 &random) {
+        size_t changes = (size_t) ((double) liveFiles.size() * parameters.churn);
+        for (size_t i = 0; i < changes; i++) {
+            int operation = (int) (random() % 3);
+            if (operation == 1 || liveFiles.empty()) {
+                liveFiles.push_back(nextIndex);
+                generate_file(filesystem, "/src" + get_relative_path(nextIndex++), random);
                 continue;
             }
 
-            //check if files in source directory are already in destination directory
-            //if so, check if they are the same, if not, copy them
-            for (const auto &file: sourceDirFiles) {
-                //check if file is in destination directory, if not, copy it
-                if (!utils::is_file_or_directory_exists(file.mirrorPath)) {
-                    utils::log(Operation::DAEMON_WORK_INFO,
-                               "File " + file.path + " not found in destination directory, copying");
-                    utils::file_copy(file, file.mirrorPath);
-                    continue;
-                }
-
-                //search for file struct in destination directory, which corresponds to current file path
-                for (const auto &destinationFile: destinationDirFiles) {
-                    if (file.mirrorPath == destinationFile.path) {
+            size_t position = random() % liveFiles.size();
+            string path = "/src" + get_relative_path(liveFiles[position]);
+            if (operation == 0) {
+                generate_file(filesystem, path, random);
+            } else {
+                filesystem.erase(path);
+                liveFiles[position] = liveFiles.back();
+                liveFiles.pop_back();
+            }
+        }
+    }
 
-                        //check if files (source and destination) are the same
-                        if (file.size != destinationFile.size || file.lastModified != destinationFile.lastModified) {
-                            utils::log(Operation::DAEMON_WORK_INFO, "File " + file.path +
-                                                                    " is different in source and destination directory, replacing");
-                            utils::file_copy(file, file.mirrorPath);
-                        }
-                        break;
-                    }
-                }
+    void handle_args_parse(const string &arg) {
+        if (!utils::string_starts_with(arg, "--sim-")) return;
+
+        try {
+            string value = arg.substr(arg.find('=') + 1);
+            if (utils::string_starts_with(arg, "--sim-files=")) {
+                parameters.files = stoull(value);
+            } else if (utils::string_starts_with(arg, "--sim-cycles=")) {
+                parameters.cycles = stoi(value);
+            } else if (utils::string_starts_with(arg, "--sim-churn=")) {
+                parameters.churn = stod(value);
+            } else if (utils::string_starts_with(arg, "--sim-seed=")) {
+                parameters.seed = stoull(value);
+            } else if (utils::string_starts_with(arg, "--sim-file-size=")) {
+                parameters.fileSize = stoull(value);
+            } else if (utils::string_starts_with(arg, "--sim-latency-us=")) {
+                parameters.faults.latencyMicroseconds = stoull(value);
+            } else if (utils::string_starts_with(arg, "--sim-stat-latency-us=")) {
+                parameters.faults.statLatencyMicroseconds = stoull(value);
+            } else if (utils::string_starts_with(arg, "--sim-list-error-rate=")) {
+                parameters.faults.listErrorRate = stod(value);
+            } else if (utils::string_starts_with(arg, "--sim-stat-error-rate=")) {
+                parameters.faults.statErrorRate = stod(value);
+            } else if (utils::string_starts_with(arg, "--sim-read-error-rate=")) {
+                parameters.faults.readErrorRate = stod(value);
+            } else if (utils::string_starts_with(arg, "--sim-short-write-rate=")) {
+                parameters.faults.shortWriteRate = stod(value);
+            } else if (utils::string_starts_with(arg, "--sim-capacity-mb=")) {
+                parameters.faults.capacity = stoull(value) * 1024 * 1024;
+            } else {
+                throw invalid_argument("unknown simulation parameter");
             }
+        } catch (exception &e) {
+            cerr << "Failed to parse simulation parameter " << arg << " due to: " << e.what() << endl;
+            exit(-1);
+        }
+    }
 
-            //check if after removing files from destination directory, there are no empty directories left
-            //if so, delete them
-            utils::remove_empty_directories(destinationPath);
+    //returns true if destination is equal to source after last (fault free) cycle
+    bool run() {
+        vfs::MemoryFileSystem filesystem(parameters.seed);
+        mt19937_64 random(parameters.seed);
+        vfs::current = &filesystem;
+
+        vector<size_t> liveFiles;
+        size_t nextIndex = 0;
+        for (; nextIndex < parameters.files; nextIndex++) {
+            generate_file(filesystem, "/src" + get_relative_path(nextIndex), random);
+            liveFiles.push_back(nextIndex);
+        }
+        filesystem.put_directory("/dst");
 
-            //reset daemon busy flag
-            settings::daemon_busy = false;
-            utils::log(Operation::DAEMON_SLEEP, "Daemon finished file synchronization");
+        size_t mismatches = 0;
+        for (int cycle = 0; cycle <= parameters.cycles; cycle++) {
+            bool recovery = cycle == parameters.cycles;
 
+            //first cycle copies whole tree
+            //clock is advanced by 1 ns, so modified files differ from their copies only below second precision
+            if (cycle > 0) {
+                filesystem.advance_clock(1);
+                apply_churn(filesystem, liveFiles, nextIndex, random);
+            }
+            //copies get different modification time than source, unless engine sets it
+            filesystem.advance_clock(1);
+
+            filesystem.faults = recovery ? vfs::FaultModel() : parameters.faults;
+            size_t operations = filesystem.operations;
+            size_t simulatedMicroseconds = filesystem.simulatedMicroseconds;
+
+            auto start = chrono::steady_clock::now();
+            actions::synchronize("/src", "/dst");
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            filesystem.faults = vfs::FaultModel();
+            mismatches = verify(filesystem, liveFiles);
+
+            cout << (recovery ? "recovery" : "cycle " + to_string(cycle)) << ": " << liveFiles.size() << " files in "
+                 << fixed << setprecision(3) << seconds << " s (" << setprecision(0)
+                 << (double) liveFiles.size() / seconds << " files/s), " << filesystem.operations - operations
+                 << " operations, simulated latency " << setprecision(3)
+                 << (double) (filesystem.simulatedMicroseconds - simulatedMicroseconds) / 1e6 << " s, "
+                 << mismatches << " mismatched files" << endl;
         }
+
+        vfs::current = &vfs::posix_filesystem;
+        return mismatches == 0;
     }
 }
 
@@ -778,6 +3549,32 @@ bool transform_to_daemon() {
 int main(int argc, char *argv[]) {
     utils::log(Operation::DAEMON_INIT, "[*] File synchronization daemon started");
 
+    //rebuild plain directory tree from chunk store and exit
+    if (argc == 4 && string(argv[1]) == "--export") {
+        settings::debug = true;
+        return chunkstore::export_tree(argv[2], argv[3]) ? 0 : -1;
+    }
+
+    //run synchronization engine on in-memory filesystem and exit
+    if (argc >= 2 && string(argv[1]) == "--simulate") {
+        settings::simulation = true;
+        settings::recursive = true;
+        for (int i = 2; i < argc; i++) {
+            simulation::handle_args_parse(argv[i]);
+            actions::handle_additional_args_parse(argv[i]);
+        }
+
+        if (settings::chunk_store || !settings::snapshot_dir.empty()) {
+            cerr << "Snapshots and chunk store can't be used in simulation" << endl;
+            return -1;
+        }
+        if (!settings::filter_file.empty() && !filter::load_rules_file(settings::filter_file, filter::global_rules)) {
+            cerr << "Failed to read filter rules file " << settings::filter_file << endl;
+            return -1;
+        }
+        return simulation::run() ? 0 : -1;
+    }
+
     if (argc < 3) {
         utils::display_usage(argv[0]);
         utils::log(Operation::DAEMON_INIT_ERROR, "Not enough arguments supplied, expected 3, got " + to_string(argc));
@@ -806,12 +3603,47 @@ int main(int argc, char *argv[]) {
     if (settings::sleep_time == 0) {
         settings::sleep_time = DEFAULT_SLEEP_TIME;
     }
+
+    //snapshots can't be stored inside synchronized directories, they would be scanned (and deleted) by daemon
+    if (!settings::snapshot_dir.empty() && !actions::validate_snapshot_dir(sourcePath, destinationPath)) {
+        return -1;
+    }
+
+    //chunks referenced only by snapshots would be removed by chunk garbage collection
+    if (settings::chunk_store && !settings::snapshot_dir.empty()) {
+        cerr << "Snapshots can't be used in chunk store mode" << endl;
+        utils::log(Operation::DAEMON_INIT_ERROR, "Snapshots can't be used in chunk store mode");
+        return -1;
+    }
+
+    //recipes contain only size and modification time of source file
+    if (settings::chunk_store && (settings::preserve_mode || settings::preserve_owner || settings::preserve_xattr)) {
+        cerr << "Mode, owner and extended attributes can't be preserved in chunk store mode" << endl;
+        utils::log(Operation::DAEMON_INIT_ERROR, "Mode, owner and extended attributes can't be preserved in chunk store mode");
+        return -1;
+    }
+
+    if (settings::chunk_store && !chunkstore::initialize(destinationPath)) {
+        return -1;
+    }
+
+    //compile global filter rules once, before first scan
+    if (!settings::filter_file.empty() && !filter::load_rules_file(settings::filter_file, filter::global_rules)) {
+        cerr << "Failed to read filter rules file " << settings::filter_file << endl;
+        utils::log(Operation::DAEMON_INIT_ERROR, "Failed to read filter rules file " + settings::filter_file);
+        return -1;
+    }
     //</editor-fold>
 
     utils::log(Operation::DAEMON_INIT,
                "Daemon initialized with source path: " + sourcePath + " and destination path: " +
                destinationPath + " and sleep time: " + to_string(settings::sleep_time) + " seconds");
 
+    //synchronize once without creating daemon, exit code tells if all files were synchronized
+    if (settings::once) {
+        return actions::synchronize(sourcePath, destinationPath) ? 0 : -1;
+    }
+
     //if debug mode is enabled, don't transform to daemon
     //and handle signals manually
     if (settings::debug) {